@@ -0,0 +1,20 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * bench.h - Boot-time benchmarks for URIX.
+ * Responsibilities:
+ *  - declare the entry point kernel_main calls in a BENCH=1 build
+ * Notes:
+ *  - `make iso BENCH=1` defines URIX_BENCH and builds src/bench.c; a normal
+ *    build has neither
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+* runs every benchmark and prints the results; call after slab_init and
+* before bootmem_release
+*/
+void kernel_bench(void);
+
+#endif
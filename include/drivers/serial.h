@@ -0,0 +1,57 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * serial.h - 16550 UART (COM1) console driver header.
+ * Responsibilities:
+ *  - declare setup of COM1 as a 115200 8N1 output port
+ *  - declare the buffered write path and the non-blocking pump
+ *  - expose the port as a log ring console sink
+ * Notes:
+ *  - output is queued in a SERIAL_TX_BYTES ring and sent in FIFO-sized
+ *    bursts by serial_flush, which never waits for the UART; whoever has
+ *    time (the idle loop) calls it until serial_pending is 0
+ *  - nothing is dropped: a writer that finds the ring full waits for the
+ *    UART and sends a burst itself
+ *  - "\n" is sent as "\r\n"
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/log.h>
+
+#define SERIAL_COM1 0x3F8
+#define SERIAL_BAUD 115200U
+
+/* Transmit ring size (power of two) */
+#define SERIAL_TX_BYTES 4096U
+
+/*
+* programs COM1 and checks it with a loopback test.
+* returns 0 if the port works, -1 if there is no UART (output is then discarded)
+*/
+int serial_init(void);
+
+/*
+* queues len bytes for transmission
+*/
+void serial_write(const char *data, size_t len);
+
+/*
+* sends one FIFO-sized burst of queued bytes if the transmitter is empty,
+* otherwise nothing; never waits
+*/
+void serial_flush(void);
+
+/*
+* returns the number of bytes queued but not yet sent
+*/
+size_t serial_pending(void);
+
+/*
+* log ring sink for COM1 (register with log_register_sink after serial_init)
+*/
+extern console_sink_t serial_console_sink;
+
+#endif
@@ -7,6 +7,10 @@
  * Notes:
  *  - provides enum vga_color_t for 16 VGA colors
  *  - API designed for simplicity and compatibility with URIX console
+ *  - output goes to a RAM shadow; console_write (and so kprintf) flushes
+ *    it to the screen, single-character calls need console_flush
+ *  - scrolling pans the visible window over the text buffer (CRTC start
+ *    address); console_flush also moves the hardware cursor
  */
 
 #ifndef VGA_H
@@ -14,6 +18,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <lib/log.h>
 
 // VGA text mode constants
 #define VGA_WIDTH 80       // width of screen in characters
@@ -64,6 +69,7 @@ void console_set_color(uint8_t color);
 
 /*
 * takes a character, color and placement (x and y coordinates) and puts it on the screen
+* (visible after the next console_flush)
 */
 void console_putentryat(char c, uint8_t color, size_t x, size_t y);
 
@@ -75,11 +81,17 @@ void console_scroll_up(void);
 /*
 * adds one character to the screen, handles \n \t and \r
 * moves a line down if the line is too long (longer than the screen size)
+* (visible after the next console_flush)
 */
 void console_putchar(char c);
 
 /*
-* takes a string and its size and puts it on the string in the correct place
+* copies the rows changed since the last flush to the VGA text buffer
+*/
+void console_flush(void);
+
+/*
+* takes a string and its size and puts it on the string in the correct place, then flushes
 */
 void console_write(const char *data, size_t size);
 
@@ -98,4 +110,9 @@ void console_clear(void);
 */
 void console_puts(const char *str);
 
+/*
+* log ring sink that prints to the screen (register with log_register_sink)
+*/
+extern console_sink_t vga_console_sink;
+
 #endif
\ No newline at end of file
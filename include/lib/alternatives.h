@@ -0,0 +1,65 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * alternatives.h - Boot-time patched jump sites.
+ * Responsibilities:
+ *  - define a function as a single jmp to its generic implementation
+ *    (ALT_JUMP_SITE)
+ *  - register better implementations gated on a CPU feature (ALT_JUMP)
+ *  - retarget every site once at boot (alternatives_apply)
+ * Notes:
+ *  - a site is a 5-byte jmp rel32; alternatives_apply rewrites its
+ *    displacement, so callers reach the chosen body with one direct jump
+ *    and no feature test at run time
+ *  - entries live in the .alt_jumps section (see linker.ld); for one site
+ *    the first entry whose feature is present wins, so list the best first
+ *  - the table is part of the .init section and is freed after boot
+ *  - until alternatives_apply runs, every site jumps to its generic body,
+ *    which must be correct on any x86-64 CPU
+ *  - bodies referenced only from a site or an entry must be
+ *    __attribute__((used)), the compiler cannot see the asm references
+ *  - the kernel is single-CPU and sites are patched before interrupts are
+ *    enabled, so no other context can execute a half-written jmp
+ */
+
+#ifndef ALTERNATIVES_H
+#define ALTERNATIVES_H
+
+#include <stdint.h>
+
+/* One .alt_jumps entry; layout must match ALT_JUMP */
+typedef struct alt_jump
+{
+    uint8_t *site;      /* the jmp rel32 */
+    const void *target; /* body to jump to when feature is present */
+    uint32_t feature;   /* X86_FEATURE_* */
+    uint32_t reserved;
+} alt_jump_t;
+
+#define ALT_STR_(x) #x
+#define ALT_STR(x) ALT_STR_(x)
+
+/* Define global function name as "jmp fallback" (always the 5-byte form) */
+#define ALT_JUMP_SITE(name, fallback)                    \
+    __asm__(".pushsection .text.alt_sites, \"ax\"\n"     \
+            ".globl " #name "\n"                         \
+            ".type " #name ", @function\n"               \
+            ".p2align 4\n" #name ":\n"                   \
+            ".byte 0xe9\n"                               \
+            ".long " #fallback " - . - 4\n"              \
+            ".size " #name ", 5\n"                       \
+            ".popsection")
+
+/* Retarget site name to target when the CPU has feature */
+#define ALT_JUMP(name, feature, target)                  \
+    __asm__(".pushsection .alt_jumps, \"a\"\n"           \
+            ".p2align 3\n"                               \
+            ".quad " #name ", " #target "\n"             \
+            ".long " ALT_STR(feature) ", 0\n"            \
+            ".popsection")
+
+/* Patch every jump site for the features in cpu_features.
+ * Must run after cpu_features_init and before interrupts are enabled.
+ */
+void alternatives_apply(void);
+
+#endif /* ALTERNATIVES_H */
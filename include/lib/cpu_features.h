@@ -0,0 +1,118 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * cpu_features.h - CPU feature set, parsed from CPUID once at boot.
+ * Responsibilities:
+ *  - read the CPUID leaves the kernel cares about into one bitmap
+ *  - name every feature bit as X86_FEATURE_* (word * 32 + bit)
+ *  - answer cpu_has() with a single load, no CPUID on the hot path
+ * Notes:
+ *  - cpu_features_init must run first thing in kernel_main; before it every
+ *    cpu_has() is 0, which always selects the safe fallback
+ *  - AVX / AVX2 are cleared unless the OS has enabled the YMM state in XCR0,
+ *    so cpu_has() means "usable", not just "present"
+ *  - X86_FEATURE_* are plain integer expressions so the alternatives table
+ *    (lib/alternatives.h) can use them from inline assembly
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <stdint.h>
+
+/* Feature words: the CPUID register each one is copied from */
+#define CPU_WORD_1_EDX 0     /* CPUID.01h:EDX */
+#define CPU_WORD_1_ECX 1     /* CPUID.01h:ECX */
+#define CPU_WORD_7_EBX 2     /* CPUID.(07h, 0):EBX */
+#define CPU_WORD_7_ECX 3     /* CPUID.(07h, 0):ECX */
+#define CPU_WORD_7_EDX 4     /* CPUID.(07h, 0):EDX */
+#define CPU_WORD_EXT1_EDX 5  /* CPUID.80000001h:EDX */
+#define CPU_WORD_EXT1_ECX 6  /* CPUID.80000001h:ECX */
+#define CPU_WORD_EXT7_EDX 7  /* CPUID.80000007h:EDX */
+#define CPU_FEATURE_WORDS 8
+
+/* CPUID.01h:EDX */
+#define X86_FEATURE_FPU (0 * 32 + 0)
+#define X86_FEATURE_TSC (0 * 32 + 4)
+#define X86_FEATURE_MSR (0 * 32 + 5)
+#define X86_FEATURE_PAE (0 * 32 + 6)
+#define X86_FEATURE_APIC (0 * 32 + 9)
+#define X86_FEATURE_PGE (0 * 32 + 13)
+#define X86_FEATURE_PAT (0 * 32 + 16)
+#define X86_FEATURE_CLFLUSH (0 * 32 + 19)
+#define X86_FEATURE_FXSR (0 * 32 + 24)
+#define X86_FEATURE_SSE (0 * 32 + 25)
+#define X86_FEATURE_SSE2 (0 * 32 + 26)
+
+/* CPUID.01h:ECX */
+#define X86_FEATURE_SSE3 (1 * 32 + 0)
+#define X86_FEATURE_SSSE3 (1 * 32 + 9)
+#define X86_FEATURE_FMA (1 * 32 + 12)
+#define X86_FEATURE_CX16 (1 * 32 + 13)
+#define X86_FEATURE_PCID (1 * 32 + 17)
+#define X86_FEATURE_SSE4_1 (1 * 32 + 19)
+#define X86_FEATURE_SSE4_2 (1 * 32 + 20)
+#define X86_FEATURE_X2APIC (1 * 32 + 21)
+#define X86_FEATURE_POPCNT (1 * 32 + 23)
+#define X86_FEATURE_TSC_DEADLINE (1 * 32 + 24)
+#define X86_FEATURE_XSAVE (1 * 32 + 26)
+#define X86_FEATURE_OSXSAVE (1 * 32 + 27)
+#define X86_FEATURE_AVX (1 * 32 + 28)
+#define X86_FEATURE_RDRAND (1 * 32 + 30)
+#define X86_FEATURE_HYPERVISOR (1 * 32 + 31)
+
+/* CPUID.(07h, 0):EBX */
+#define X86_FEATURE_FSGSBASE (2 * 32 + 0)
+#define X86_FEATURE_BMI1 (2 * 32 + 3)
+#define X86_FEATURE_AVX2 (2 * 32 + 5)
+#define X86_FEATURE_SMEP (2 * 32 + 7)
+#define X86_FEATURE_BMI2 (2 * 32 + 8)
+#define X86_FEATURE_ERMS (2 * 32 + 9)
+#define X86_FEATURE_INVPCID (2 * 32 + 10)
+#define X86_FEATURE_RDSEED (2 * 32 + 18)
+#define X86_FEATURE_SMAP (2 * 32 + 20)
+#define X86_FEATURE_CLFLUSHOPT (2 * 32 + 23)
+
+/* CPUID.(07h, 0):ECX / EDX */
+#define X86_FEATURE_UMIP (3 * 32 + 2)
+#define X86_FEATURE_FSRM (4 * 32 + 4)
+
+/* CPUID.80000001h:EDX / ECX */
+#define X86_FEATURE_SYSCALL (5 * 32 + 11)
+#define X86_FEATURE_NX (5 * 32 + 20)
+#define X86_FEATURE_PDPE1GB (5 * 32 + 26)
+#define X86_FEATURE_RDTSCP (5 * 32 + 27)
+#define X86_FEATURE_LM (5 * 32 + 29)
+#define X86_FEATURE_LAHF_LM (6 * 32 + 0)
+#define X86_FEATURE_LZCNT (6 * 32 + 5)
+
+/* CPUID.80000007h:EDX */
+#define X86_FEATURE_INVARIANT_TSC (7 * 32 + 8)
+
+typedef struct cpu_features
+{
+    uint32_t words[CPU_FEATURE_WORDS];
+    uint32_t max_leaf;     /* highest basic CPUID leaf */
+    uint32_t max_ext_leaf; /* highest 0x8000xxxx leaf, 0 if none */
+    uint32_t family;       /* display family / model (extended fields folded in) */
+    uint32_t model;
+    uint32_t stepping;
+    char vendor[13];       /* "GenuineIntel", "AuthenticAMD", ... */
+} cpu_features_t;
+
+extern cpu_features_t cpu_features;
+
+/*
+ * returns 1 if the CPU has (and the kernel may use) feature, 0 otherwise.
+ */
+static inline int cpu_has(unsigned feature)
+{
+    return (cpu_features.words[feature / 32] >> (feature % 32)) & 1;
+}
+
+/* Run CPUID once and fill cpu_features */
+void cpu_features_init(void);
+
+/* Print the vendor, model and feature list */
+void cpu_features_print(void);
+
+#endif /* CPU_FEATURES_H */
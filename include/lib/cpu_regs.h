@@ -0,0 +1,76 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * cpu_regs.h - Control register and MSR access for URIX.
+ * Responsibilities:
+ *  - read and write CR3 / CR4
+ *  - read and write model-specific registers
+ *  - read extended control registers (XCR0)
+ *  - name the CR3 / CR4 bits the memory code uses
+ * Notes:
+ *  - all helpers are privileged (ring 0 only)
+ *  - CR3 / CR4 writes are compiler barriers ("memory" clobber)
+ */
+
+#ifndef CPU_REGS_H
+#define CPU_REGS_H
+
+#include <stdint.h>
+
+#define CR4_PGE (1ULL << 7)    /* global pages */
+#define CR4_PCIDE (1ULL << 17) /* process-context identifiers */
+
+#define CR3_PCID_MASK 0xFFFULL     /* PCID in CR3[11:0] when CR4.PCIDE = 1 */
+#define CR3_NOFLUSH (1ULL << 63)   /* keep the new PCID's TLB entries (PCIDE only) */
+
+#define XCR0_X87 (1ULL << 0)
+#define XCR0_SSE (1ULL << 1)
+#define XCR0_AVX (1ULL << 2)
+
+#define MSR_EFER 0xC0000080U
+#define EFER_NXE (1ULL << 11)
+
+static inline uint64_t read_cr3(void)
+{
+    uint64_t v;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr3(uint64_t v)
+{
+    __asm__ volatile("mov %0, %%cr3" : : "r"(v) : "memory");
+}
+
+static inline uint64_t read_cr4(void)
+{
+    uint64_t v;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v)
+{
+    __asm__ volatile("mov %0, %%cr4" : : "r"(v) : "memory");
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t v)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+/* Only valid once CR4.OSXSAVE is set (boot.S does when CPUID has XSAVE) */
+static inline uint64_t xgetbv(uint32_t xcr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(xcr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * cpuid.h - CPUID instruction helpers for URIX.
+ * Responsibilities:
+ *  - execute CPUID for a given leaf / subleaf
+ * Notes:
+ *  - boot.S has already verified that CPUID and long mode exist
+ *  - callers must check the maximum extended leaf before using 0x8000xxxx
+ *  - feature checks go through lib/cpu_features.h, which runs CPUID once
+ */
+
+#ifndef CPUID_H
+#define CPUID_H
+
+#include <stdint.h>
+
+/*
+ * runs CPUID with eax = leaf, ecx = subleaf and stores the four result registers.
+ */
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+/*
+ * returns the maximum basic leaf.
+ */
+static inline uint32_t cpuid_max_leaf(void)
+{
+    uint32_t a, b, c, d;
+
+    cpuid(0, 0, &a, &b, &c, &d);
+    return a;
+}
+
+#endif
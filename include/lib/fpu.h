@@ -0,0 +1,39 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * fpu.h - Kernel SIMD (SSE / AVX) support for URIX.
+ * Responsibilities:
+ *  - report which SIMD level boot.S enabled (SSE2 always, AVX2 if possible)
+ *  - bracket kernel code that touches XMM / YMM registers
+ * Notes:
+ *  - the kernel is built with -mgeneral-regs-only, so only functions marked
+ *    __attribute__((target(...))) emit vector instructions; call them only
+ *    between kernel_fpu_begin and kernel_fpu_end
+ *  - no task owns FPU state yet, so begin / end do not save registers; they
+ *    keep interrupts off so a handler can never observe a half-used
+ *    register file. Once tasks have FPU state, begin must save it first.
+ *  - regions nest and must stay short (interrupts are disabled)
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    FPU_SIMD_NONE = 0, /* before fpu_init */
+    FPU_SIMD_SSE2,
+    FPU_SIMD_AVX2,
+} fpu_simd_t;
+
+/* Detect what boot.S enabled (XCR0) and what the CPU supports */
+void fpu_init(void);
+
+/* Widest vector extension kernel code may use */
+fpu_simd_t fpu_simd_level(void);
+
+/* Enter / leave a region that may use SIMD registers */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif
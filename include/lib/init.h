@@ -0,0 +1,26 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * init.h - Boot-only code and data markers.
+ * Responsibilities:
+ *  - place boot-only functions in .init.text (__init) and data in
+ *    .init.data (__initdata)
+ * Notes:
+ *  - linker.ld collects both into the page-aligned .init section
+ *    [__init_start, __init_end); bootmem_release gives its frames back to
+ *    the PMM at the end of kernel initialization
+ *  - nothing may call an __init function or touch __initdata after that;
+ *    only mark code that runs strictly before bootmem_release
+ *  - string literals used by __init code stay in .rodata
+ */
+
+#ifndef INIT_H
+#define INIT_H
+
+#define __init __attribute__((section(".init.text")))
+#define __initdata __attribute__((section(".init.data")))
+
+/* Bounds of the .init section (kernel virtual addresses, see linker.ld) */
+extern char __init_start[];
+extern char __init_end[];
+
+#endif /* INIT_H */
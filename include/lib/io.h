@@ -0,0 +1,34 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * io.h - x86 port I/O helpers for URIX.
+ * Responsibilities:
+ *  - read and write 8-bit I/O ports
+ * Notes:
+ *  - the asm is volatile so port accesses are never merged or reordered
+ *    against each other
+ */
+
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+/*
+ * writes one byte to an I/O port.
+ */
+static inline void outb(uint16_t port, uint8_t v)
+{
+    __asm__ volatile("outb %0, %1" : : "a"(v), "Nd"(port));
+}
+
+/*
+ * reads one byte from an I/O port.
+ */
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t v;
+    __asm__ volatile("inb %1, %0" : "=a"(v) : "Nd"(port));
+    return v;
+}
+
+#endif
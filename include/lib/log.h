@@ -0,0 +1,98 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * log.h - Kernel log ring (dmesg) for URIX.
+ * Responsibilities:
+ *  - keep the most recent LOG_RECORDS records in memory, each with a
+ *    sequence number, a TSC timestamp and a level
+ *  - let any context append a record without taking a lock
+ *  - let readers walk the ring by sequence number, and drain it to every
+ *    registered console sink (VGA, serial)
+ * Notes:
+ *  - records are fixed-size slots; writing one is a fetch-and-add on the
+ *    sequence counter plus a copy of at most LOG_TEXT_MAX bytes
+ *  - longer text is split over several records, the later ones carry
+ *    LOG_CONT
+ *  - once the ring is full the oldest records are overwritten; readers see
+ *    the gap in the sequence numbers
+ *  - consoles show records up to log_console_level; the others are only
+ *    kept in the ring
+ *  - a sink starts at the oldest record still in the ring, so one
+ *    registered late still gets the boot log
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Record slots in the ring (power of two) */
+#define LOG_RECORDS 1024U
+
+/* Text bytes per record */
+#define LOG_TEXT_MAX 104U
+
+/* Levels, as in syslog: lower is more severe */
+#define LOG_ERR 3
+#define LOG_WARN 4
+#define LOG_INFO 6
+#define LOG_DEBUG 7
+
+/* Record continues the text of the previous one */
+#define LOG_CONT 0x01
+
+typedef struct
+{
+    uint64_t seq; /* see log.c: commit word, equals the sequence number once written */
+    uint64_t tsc; /* rdtsc at log_store */
+    uint16_t len; /* bytes used in text (not terminated) */
+    uint8_t level;
+    uint8_t flags; /* LOG_CONT */
+    uint32_t reserved;
+    char text[LOG_TEXT_MAX];
+} log_record_t;
+
+/* An output device the ring is drained to */
+typedef struct console_sink
+{
+    const char *name;
+    void (*write)(const char *text, size_t len); /* queue or print text */
+    void (*flush)(void);                         /* push queued text out, may be NULL */
+    uint64_t seq;                                /* next record to write (log.c) */
+    struct console_sink *next;
+} console_sink_t;
+
+/* Records above this level are not printed (default LOG_INFO) */
+extern int log_console_level;
+
+/* Append len bytes of text at level; returns the sequence number of the
+ * first record used. Never blocks, callable from any context.
+ */
+uint64_t log_store(int level, const char *text, size_t len);
+
+/* log_store with the flags of the first record given, e.g. LOG_CONT for a
+ * message stored in several calls
+ */
+uint64_t log_store_flags(int level, uint8_t flags, const char *text, size_t len);
+
+/* Copy the oldest record with sequence number >= *seq into rec and set
+ * *seq past it. Returns 1 on success, 0 when there is nothing (committed)
+ * to read. Overwritten records are skipped; rec->seq tells the reader.
+ */
+int log_read(uint64_t *seq, log_record_t *rec);
+
+/* Sequence number the next record will get */
+uint64_t log_next_seq(void);
+
+/* Add sink to the drain list and write the ring's contents to it */
+void log_register_sink(console_sink_t *sink);
+
+/* Write the records each sink has not shown yet to it, then flush it */
+void log_console_flush(void);
+
+/* Print every record still in the ring, with timestamps and levels, to
+ * every sink
+ */
+void log_dump(void);
+
+#endif /* LOG_H */
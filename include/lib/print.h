@@ -2,18 +2,21 @@
  * Licensed under MIT License - URIX project.
  * print.h - Console printing interface for URIX.
  * Responsibilities:
- *  - declare printf-style output (kprintf)
+ *  - declare printf-style output (kprintf, klog)
  *  - declare screen management (clear_screen, set_color)
  *  - provide number formatting (print_uint64, print_hex)
  * Notes:
  *  - depends on vga.h for color and display control
- *  - formatting core (kvsnprintf) defined in print.c
+ *  - formatting core (kvformat, kvsnprintf) defined in print.c
+ *  - %lx / %llx print a 0x prefix (see print.c)
+ *  - messages are kept in the log ring (log.h) and drained to the console
  */
 
 #ifndef PRINT_H
 #define PRINT_H
 
 #include <drivers/vga.h>
+#include <lib/log.h>
 #include <stdarg.h>
 
 /*
@@ -22,6 +25,12 @@
 */
 void kprintf(const char *fmt, ...);
 
+/*
+* like kprintf, at a log level (LOG_ERR ... LOG_DEBUG); levels above
+* log_console_level are only kept in the log ring
+*/
+void klog(int level, const char *fmt, ...);
+
 /*
 * wraps the function "screen_initialize" from terminal.c 
 */
@@ -33,11 +42,27 @@ void clear_screen(void);
 void set_color(vga_color_t fg, vga_color_t bg);
 
 /*
-* takes a string, it's length, a pointer to another string and a list of arguments.
-* takes the original string the places the data from the arguments list into the string in the correct places.
-* saves the new string into the fmt string pointer
+* receives formatted output piece by piece (ctx is passed through unchanged)
+*/
+typedef void (*kformat_sink_t)(void *ctx, const char *s, size_t n);
+
+/*
+* formats fmt with the arguments in args and hands the output to sink as it is produced.
+* returns the number of bytes produced
+*/
+int kvformat(kformat_sink_t sink, void *ctx, const char *fmt, va_list args);
+
+/*
+* takes a buffer, its size, a format string and a list of arguments.
+* writes at most size - 1 bytes of the formatted string plus a terminating 0 into buf.
+* returns the length the full string has (larger than size - 1 if it was cut)
+*/
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+
+/*
+* kvsnprintf with variable arguments
 */
-void kvsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...);
 
 /*
 * takes an unsigend 64 bit integer and prints it onto the screen correctly
@@ -3,10 +3,13 @@
  * string.h - String and number conversion helpers for URIX.
  * Responsibilities:
  *  - declare strlen, reverse, itoa, utoa
+ *  - declare memset, memcpy, memmove, memcmp and streaming-store variants
  *  - provide lightweight replacement for libc string/stdio utilities
  * Notes:
  *  - focused on kernel use (no malloc, no locale support)
  *  - supports integer bases 2–36
+ *  - mem* and str* work before alternatives_apply / string_init, just
+ *    without rep stosb / movsb and without SIMD
  */
 
 
@@ -14,12 +17,37 @@
 #define STRING_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+/* From this size on, mem* use rep string instructions (rep movsb / stosb
+ * with ERMS, rep movsq / stosq otherwise)
+ */
+#define MEM_REP_MIN 256U
+
+/* With FSRM, rep movsb / stosb win from this size on */
+#define MEM_REP_MIN_FSRM 64U
+
+/* Below this size memset_nt / memcpy_nt fall back to memset / memcpy */
+#define MEM_NT_MIN 256U
+
+/* From this size on, strlen / strnlen / memchr / memcmp use SSE2 / AVX2 */
+#define MEM_SIMD_MIN 64U
 
 /*
  * takes a string and returns its length in size_t (unsigned long)
  */
 uint64_t strlen(const char *str);
 
+/*
+ * returns strlen(str), but looks at no more than maxlen bytes.
+ */
+size_t strnlen(const char *str, size_t maxlen);
+
+/*
+ * returns a pointer to the first byte equal to (unsigned char)c in [s, s + n), or NULL.
+ */
+void *memchr(const void *s, int c, size_t n);
+
 /*
 * takes a string buffer and its length, reverses the string inside the buffer (in place).
 */
@@ -29,17 +57,45 @@ void reverse(char *str, size_t len);
  * takes a number, a character buffer (string) and a base (like 2, 10 and 16), and returns a string value of the number based on the base
  * it also puts the same number in the buffer it takes
  */
-char *itoa(uint64_t num, char *buffer, int base);
+char *itoa(int64_t num, char *buffer, int base);
 
 /*
  * takes an unsigned long long (64 bit number), a character buffer and a base, and returns a string value of the number based on the base give.
  */
 char *utoa(uint64_t num, char *buffer, int base);
 
+/*
+ * picks up the SIMD level; call once at boot, after fpu_init.
+ */
+void string_init(void);
+
 /*
  * takes a destination pointer, value, and size to iterate on.
  * enters the value given into the given count of bytes in memory, starting at the dest pointer given.
  */
- void *memset(void *dest, int value, uint64_t count);
+void *memset(void *dest, int value, uint64_t count);
+
+/*
+ * copies count bytes from src to dest; the ranges must not overlap.
+ */
+void *memcpy(void *dest, const void *src, uint64_t count);
+
+/*
+ * copies count bytes from src to dest; the ranges may overlap.
+ */
+void *memmove(void *dest, const void *src, uint64_t count);
+
+/*
+ * compares count bytes; returns <0, 0 or >0 like the first differing byte (unsigned).
+ */
+int memcmp(const void *a, const void *b, uint64_t count);
+
+/*
+ * memset / memcpy with non-temporal (streaming) stores that bypass the caches.
+ * For page-sized and larger buffers that will not be read again soon.
+ * Stores are fenced (sfence) before returning.
+ */
+void *memset_nt(void *dest, int value, uint64_t count);
+void *memcpy_nt(void *dest, const void *src, uint64_t count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * tsc.h - Time Stamp Counter helpers for URIX.
+ * Responsibilities:
+ *  - read the CPU time stamp counter for cheap cycle measurements
+ * Notes:
+ *  - values are raw TSC ticks, not wall time
+ *  - rdtsc is not serializing; good enough for boot-time diagnostics
+ */
+
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+
+/*
+ * returns the current value of the time stamp counter.
+ */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * slab.h - Kernel heap: slab object caches and kmalloc.
+ * Responsibilities:
+ *  - named object caches with optional constructors (kmem_cache_*)
+ *  - kmalloc / kfree over size classes from 16 B to 8 KiB
+ *  - multi-frame allocation for larger kmalloc requests
+ *  - usage, fragmentation and throughput statistics
+ * Notes:
+ *  - a slab is 2^order contiguous PMM frames, used through the direct map;
+ *    its header sits at the start and the objects follow
+ *  - every frame of a slab is tagged PAGE_TYPE_SLAB in its struct page, with
+ *    private pointing at the slab header, so kfree finds it in O(1)
+ *  - objects of a cache with a constructor are constructed once, when their
+ *    slab is created, and must be freed in constructed state; their free
+ *    list link lives behind the object so it never clobbers that state
+ *  - each cache keeps at most SLAB_KEEP_EMPTY empty slabs, the rest go back
+ *    to the PMM
+ *  - single CPU and not interrupt safe: do not allocate from IRQ handlers
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Smallest / largest kmalloc size class; larger requests take whole frames */
+#define KMALLOC_MIN_SIZE 16U
+#define KMALLOC_MAX_SIZE 8192U
+
+/* Slabs are at most 2^SLAB_MAX_ORDER frames */
+#define SLAB_MAX_ORDER 4U
+
+/* Empty slabs a cache holds on to before returning frames to the PMM */
+#define SLAB_KEEP_EMPTY 1U
+
+typedef struct kmem_cache kmem_cache_t;
+
+/* Set up the kmalloc size classes. Must run after pmm_init. */
+void slab_init(void);
+
+/* Create a cache of `size`-byte objects aligned to `align` (power of two,
+ * 0 means 8). ctor, if not NULL, runs on every object when its slab is
+ * created. Returns NULL on failure.
+ */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *obj));
+
+/* Destroy a cache; fails (returns -1) while it still has live objects */
+int kmem_cache_destroy(kmem_cache_t *cache);
+
+/* Allocate one object, or NULL when out of memory */
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+/* Return an object to the cache it came from */
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+/* Allocate `size` bytes (aligned to at least 16, to the size class up to 64).
+ * Returns NULL for size 0 or when out of memory.
+ */
+void *kmalloc(size_t size);
+
+/* kmalloc, zero-filled */
+void *kzalloc(size_t size);
+
+/* Free memory from kmalloc / kzalloc; NULL is ignored */
+void kfree(void *ptr);
+
+/* Print per-cache usage and fragmentation */
+void kmem_print_stats(void);
+
+#endif /* SLAB_H */
@@ -0,0 +1,47 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * layout.h - Kernel virtual address space layout for x86-64.
+ * Responsibilities:
+ *  - define where the kernel image and the physical direct map live
+ *  - convert between physical addresses and kernel virtual addresses
+ * Notes:
+ *  - the kernel is linked at KERNEL_VMA + 1 MiB (top 2 GiB, -mcmodel=kernel)
+ *    and loaded at physical 1 MiB; linker.ld and boot.S repeat KERNEL_VMA
+ *  - all physical memory is mapped at PHYS_MAP_BASE + phys (PML4 slot 256),
+ *    so the kernel reaches any frame at constant cost
+ *  - the whole upper half belongs to the kernel and can be shared by every
+ *    address space
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+/* Base of the kernel image window: phys 0 maps to KERNEL_VMA */
+#define KERNEL_VMA 0xFFFFFFFF80000000ULL
+
+/* Base of the direct map of all physical memory */
+#define PHYS_MAP_BASE 0xFFFF800000000000ULL
+
+/*
+ * returns the direct-map address of a physical address.
+ */
+static inline void *phys_to_virt(uint64_t phys)
+{
+    return (void *)(uintptr_t)(phys + PHYS_MAP_BASE);
+}
+
+/*
+ * returns the physical address behind a kernel image or direct-map address.
+ */
+static inline uint64_t virt_to_phys(const void *virt)
+{
+    uint64_t v = (uint64_t)(uintptr_t)virt;
+
+    if (v >= KERNEL_VMA)
+        return v - KERNEL_VMA;
+    return v - PHYS_MAP_BASE;
+}
+
+#endif /* LAYOUT_H */
@@ -0,0 +1,91 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * bootmem.h - Early bump allocator for memory needed before the PMM / heap.
+ * Responsibilities:
+ *  - carve the arena out of the first multiboot region that fits, and
+ *    extend it with further regions once all of RAM is mapped
+ *  - hand out aligned blocks by bumping a pointer; marks and resets for
+ *    scratch use, discards for ranges that turned out to be unneeded
+ *  - at the end of init, give the untouched arena tail, the discarded
+ *    ranges and the __init section back to the PMM
+ * Notes:
+ *  - the first region lies below boot_map_limit, so it is reachable
+ *    through the direct map before the kernel page tables are live; later
+ *    ones can be anywhere in RAM
+ *  - pmm_init sets the arena up and keeps all of it reserved; bootmem_alloc
+ *    keeps working after pmm_init until bootmem_release
+ *  - BOOTMEM_SCRATCH_BYTES on top of what pmm_init needs is left for early
+ *    parsers (ACPI tables, command line)
+ *  - addresses are physical; use phys_to_virt to access them
+ */
+
+#ifndef BOOTMEM_H
+#define BOOTMEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <multiboot2.h>
+
+/* Region space beyond the size asked for, if the piece of RAM has it */
+#define BOOTMEM_SCRATCH_BYTES (1024ULL * 1024ULL)
+
+/* Regions the arena can span */
+#define BOOTMEM_MAX_REGIONS 2U
+
+/* Ranges bootmem_discard can remember (discards at the top cost no slot) */
+#define BOOTMEM_MAX_DISCARDS 16U
+
+/* A physical range [start, end) */
+typedef struct
+{
+    uint64_t start;
+    uint64_t end;
+} bootmem_range_t;
+
+/* Arena position, see bootmem_mark / bootmem_reset */
+typedef uint64_t bootmem_mark_t;
+
+/* Set up the arena in the first available region of mm, below
+ * boot_map_limit and outside the `count` ranges in `exclude`, that holds at
+ * least `bytes`. Returns 0 on success, -1 if no region is large enough.
+ */
+int bootmem_init(multiboot_tag_mmap *mm, uint64_t bytes,
+                 const bootmem_range_t *exclude, unsigned count);
+
+/* Like bootmem_init, but anywhere in RAM and outside the regions already
+ * open; allocations come from the new region from then on. Only call it
+ * once the kernel page tables map all of RAM.
+ */
+int bootmem_add_region(multiboot_tag_mmap *mm, uint64_t bytes,
+                       const bootmem_range_t *exclude, unsigned count);
+
+/* Allocate `size` bytes aligned to `align` (power of two, 0 means 8).
+ * Returns a physical address, or 0 when the arena is exhausted or released.
+ * The memory is not zeroed.
+ */
+uint64_t bootmem_alloc(uint64_t size, uint64_t align);
+
+/* Current arena position; everything allocated after it can be dropped
+ * at once with bootmem_reset.
+ */
+bootmem_mark_t bootmem_mark(void);
+
+/* Roll the current region back to mark */
+void bootmem_reset(bootmem_mark_t mark);
+
+/* Give [start, end) back at bootmem_release (only whole pages are freed).
+ * A range ending at the top of its region is returned to it right away.
+ */
+void bootmem_discard(uint64_t start, uint64_t end);
+
+/* Copy the bounds of every region into out (BOOTMEM_MAX_REGIONS entries),
+ * for pmm_init to keep reserved; returns how many there are
+ */
+unsigned bootmem_regions(bootmem_range_t *out);
+
+/* Free the untouched region tails, discarded ranges and the __init section to the
+ * PMM. Call once, at the end of kernel initialization.
+ */
+void bootmem_release(void);
+
+#endif /* BOOTMEM_H */
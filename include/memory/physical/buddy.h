@@ -0,0 +1,70 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * buddy.h - Buddy-system allocator for physical frames.
+ * Responsibilities:
+ *  - define the buddy allocator state (per-order free lists and free maps)
+ *  - declare block allocation and freeing by order (4 KiB .. 1 GiB)
+ *  - declare range helpers used to seed and release arbitrary frame runs
+ * Notes:
+ *  - selected as the PMM backend with PMM_BACKEND=buddy (see rules.mk)
+ *  - frame numbers are absolute, so an order-k block is 2^k-frame aligned
+ *    in physical memory
+ *  - free list links live inside the free blocks themselves
+ *  - all operations are O(BUDDY_MAX_ORDER); freeing coalesces eagerly
+ */
+
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Order 0 = 4 KiB, order 9 = 2 MiB, order 18 = 1 GiB */
+#define BUDDY_MAX_ORDER 18U
+#define BUDDY_ORDERS (BUDDY_MAX_ORDER + 1)
+
+/* Free list node, stored in the first bytes of a free block */
+typedef struct buddy_block
+{
+    struct buddy_block *next;
+    struct buddy_block *prev;
+} buddy_block_t;
+
+typedef struct buddy_allocator
+{
+    uint64_t base_frame;                  /* first frame managed */
+    uint64_t num_frames;                  /* frames in [base_frame, base_frame + num_frames) */
+    uint64_t free_frames;                 /* frames currently on the free lists */
+    uint32_t nonempty;                    /* bit k set = free_lists[k] is non-empty */
+    buddy_block_t free_lists[BUDDY_ORDERS]; /* circular list heads */
+    uint64_t free_count[BUDDY_ORDERS];    /* blocks on each list */
+    uint64_t *free_map[BUDDY_ORDERS];     /* bit per order-k block, set = block is free at order k */
+} buddy_allocator_t;
+
+/* Bytes of metadata needed to manage [base_frame, base_frame + num_frames) */
+uint64_t buddy_storage_bytes(uint64_t base_frame, uint64_t num_frames);
+
+/* Initialize an empty allocator; storage must hold buddy_storage_bytes() bytes
+ * and be 8-byte aligned. No frames are free until added with buddy_free_range.
+ */
+void buddy_init(buddy_allocator_t *b, void *storage, uint64_t base_frame, uint64_t num_frames);
+
+/* Allocate one block of 2^order frames. Returns the first frame number or -1. */
+int64_t buddy_alloc(buddy_allocator_t *b, unsigned order);
+
+/* Free a block of 2^order frames previously returned by buddy_alloc */
+void buddy_free(buddy_allocator_t *b, uint64_t frame, unsigned order);
+
+/* Allocate `count` contiguous frames aligned to `align_frames` (power of two).
+ * The unused tail of the rounded-up block goes straight back to the free lists.
+ * Returns the first frame number or -1.
+ */
+int64_t buddy_alloc_frames(buddy_allocator_t *b, uint64_t count, uint64_t align_frames);
+
+/* Free an arbitrary run of frames, splitting it into maximal aligned blocks */
+void buddy_free_range(buddy_allocator_t *b, uint64_t frame, uint64_t count);
+
+/* Print per-order free block counts */
+void buddy_print_stats(const buddy_allocator_t *b);
+
+#endif /* BUDDY_H */
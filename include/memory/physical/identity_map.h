@@ -1,16 +1,20 @@
 /*
  * Licensed under MIT License - URIX project.
- * identity_map.h - Identity Mapping interface for x86-64 with 4KB pages.
+ * identity_map.h - Kernel page table construction for x86-64 (4KB / 2MB / 1GB pages).
  * Responsibilities:
  *  - define constants and flags for page table entries
  *  - declare functions for page table allocation
- *  - provide function to build identity mapping for a physical memory range
+ *  - provide function to build the direct map and kernel image mapping
  *  - expose diagnostic function to print page table allocator usage
  * Notes:
  *  - uses 4-level page tables (PML4, PDPT, PD, PT)
  *  - PAGE_PRESENT_RW combines present and writable flags
- *  - identity_map_all maps virtual addresses equal to physical addresses
+ *  - kernel_map_all maps all RAM at PHYS_MAP_BASE and the kernel at KERNEL_VMA
+ *    (see memory/layout.h); the boot identity map is not carried over
+ *  - map_range is the general bulk mapper kernel_map_all is built on
  *  - allocator functions may be called externally if needed
+ *  - table pages come from the reserve; the PMM is only a fallback source
+ *    once it is up
  */
 
 #ifndef IDENTITY_MAP_H
@@ -25,21 +29,62 @@
 #define PAGE_PRESENT 0x1ULL
 #define PAGE_WRITE 0x2ULL
 #define PAGE_USER 0x4ULL
+#define PAGE_PWT 0x8ULL
+#define PAGE_PCD 0x10ULL
+#define PAGE_HUGE 0x80ULL /* PS bit: 2 MiB page in a PD, 1 GiB page in a PDPT */
+#define PAGE_PAT 0x80ULL /* PAT bit of a 4 KiB PTE (same position as PS) */
+#define PAGE_GLOBAL 0x100ULL
+#define PAGE_PAT_LARGE 0x1000ULL /* PAT bit of a 2 MiB / 1 GiB entry */
+#define PAGE_NX (1ULL << 63)
 #define PAGE_PRESENT_RW (PAGE_PRESENT | PAGE_WRITE)
 
+/* Large page sizes */
+#define PAGE_SIZE_2M 0x200000ULL
+#define PAGE_SIZE_1G 0x40000000ULL
+
+/* Below this physical address kernel_map_all only uses 4 KiB pages */
+#define DIRECT_MAP_SMALL_END PAGE_SIZE_2M
+
 /* Initialize the page table allocator (if needed externally) */
 void pt_alloc_init(uint64_t start_phys, uint64_t limit_phys);
 
-/* Allocate one page for page tables (returns physical address or 0 on fail) */
+/* Allocate one zeroed page for page tables (returns physical address or 0 on fail).
+ * Falls back to pmm_alloc_frame once the reserved range is used up.
+ */
 uint64_t pt_alloc_page_phys(void);
 
-/* Build identity mapping using 4KB pages.
- * map_end: inclusive end (address range [0 .. map_end) will be mapped).
- * pt_alloc_start / pt_alloc_limit: physical range used to allocate page-table pages
+/* Stop handing out pages from the reserved range.
+ * Returns the first unused physical address; [return value, old limit)
+ * may then be given back to the PMM. Later allocations come from the PMM.
+ */
+uint64_t pt_alloc_trim(void);
+
+/* Map [virt, virt + len) to [phys, phys + len) in the tree rooted at pml4.
+ * virt, phys and len must be page aligned. flags are the leaf entry flags;
+ * pml4 is the table's kernel virtual address (see phys_to_virt).
+ * PAGE_HUGE in flags allows 2 MiB / 1 GiB leaves wherever virt and phys are
+ * both aligned (1 GiB only with CPUID pdpe1gb). Missing tables come from
+ * pt_alloc_page_phys. Existing leaf entries are overwritten; slots that
+ * already hold a lower-level table are descended into, never replaced.
+ *
+ * Returns 0 on success, -1 on error (the range may be partly mapped).
+ */
+int map_range(uint64_t *pml4, uint64_t virt, uint64_t phys, uint64_t len, uint64_t flags);
+
+/* Bytes of page tables kernel_map_all can need for these bounds (worst case) */
+uint64_t kernel_map_reserve_bytes(uint64_t map_end, uint64_t kernel_end);
+
+/* Build the kernel page tables and load them into CR3.
+ * map_end: physical range [0 .. map_end) is mapped at PHYS_MAP_BASE.
+ * kernel_end: physical range [0 .. kernel_end) is mapped at KERNEL_VMA.
+ * pt_alloc_start / pt_alloc_limit: physical range used to allocate page-table
+ * pages; must lie below boot_map_limit.
+ * Uses 1GB pages (if supported) or 2MB pages, with 4KB pages below
+ * DIRECT_MAP_SMALL_END and at unaligned ends.
  *
  * Returns 0 on success, -1 on error.
  */
-int identity_map_all(uint64_t map_end, uint64_t pt_alloc_start, uint64_t pt_alloc_limit);
+int kernel_map_all(uint64_t map_end, uint64_t kernel_end, uint64_t pt_alloc_start, uint64_t pt_alloc_limit);
 
 /* Print statistics of page-table allocator usage */
 void pt_alloc_print_usage(void);
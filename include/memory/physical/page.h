@@ -0,0 +1,108 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * page.h - Per-frame descriptors (struct page) for the PMM.
+ * Responsibilities:
+ *  - define the 32-byte descriptor kept for every frame of usable RAM
+ *  - convert between frame numbers, physical / virtual addresses and
+ *    descriptors in O(1)
+ *  - declare reference counting (page_get / page_put)
+ * Notes:
+ *  - descriptors exist per 128 MiB PMM section that holds RAM (like the
+ *    bitmap), so memory-map holes cost one directory slot
+ *  - pmm_init allocates them next to the bitmap and tags every frame as
+ *    free or reserved; pmm_alloc_* hands frames out with refcount 1
+ *  - two descriptors share a cache line; the array is 64-byte aligned
+ *  - next / prev are free for the current owner (free lists, slab lists)
+ */
+
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+
+typedef enum
+{
+    PAGE_TYPE_FREE = 0,  /* on the PMM free lists / bitmap */
+    PAGE_TYPE_RESERVED,  /* never handed out (kernel, boot data, holes) */
+    PAGE_TYPE_KERNEL,    /* allocated through pmm_alloc_* */
+    PAGE_TYPE_PAGETABLE, /* page-table page owned by the VMM */
+    PAGE_TYPE_SLAB,      /* backing a kernel object cache */
+    PAGE_TYPE_COUNT
+} page_type_t;
+
+typedef struct page
+{
+    struct page *next; /* owner's list link (free list, slab list) */
+    struct page *prev;
+    uint32_t refcount; /* 0 = free or reserved */
+    uint8_t type;      /* page_type_t */
+    uint8_t zone;      /* pmm_zone_id_t */
+    uint8_t order;     /* first frame of a multi-frame allocation: log2 of
+                        * its size rounded up; 0 otherwise */
+    uint8_t flags;     /* owner-defined */
+    uint64_t private;  /* owner data */
+} page_t;
+
+_Static_assert(sizeof(page_t) == 32, "struct page must stay 32 bytes");
+
+/* Descriptor storage, set up by pmm_init:
+ *  page_dir[s]        descriptors of section s (NULL if it has no RAM)
+ *  page_map           all present sections' descriptors, in section order
+ *  page_map_section   section number of each PMM_SECTION_FRAMES slice of page_map
+ */
+extern page_t **page_dir;
+extern uint64_t page_dir_sections;
+extern page_t *page_map;
+extern uint32_t *page_map_section;
+
+/*
+ * returns the descriptor of frame pfn, or NULL if it has none.
+ */
+static inline page_t *pfn_to_page(uint64_t pfn)
+{
+    uint64_t s = pfn >> PMM_SECTION_SHIFT;
+
+    if (s >= page_dir_sections || !page_dir[s])
+        return NULL;
+    return page_dir[s] + (pfn & (PMM_SECTION_FRAMES - 1));
+}
+
+/*
+ * returns the frame number a descriptor stands for.
+ */
+static inline uint64_t page_to_pfn(const page_t *page)
+{
+    uint64_t idx = (uint64_t)(page - page_map);
+
+    return ((uint64_t)page_map_section[idx >> PMM_SECTION_SHIFT] << PMM_SECTION_SHIFT) |
+           (idx & (PMM_SECTION_FRAMES - 1));
+}
+
+static inline page_t *phys_to_page(uint64_t phys)
+{
+    return pfn_to_page(phys / PAGE_SIZE);
+}
+
+static inline uint64_t page_to_phys(const page_t *page)
+{
+    return page_to_pfn(page) * PAGE_SIZE;
+}
+
+/*
+ * returns the descriptor of the frame behind a kernel image or direct-map address.
+ */
+static inline page_t *virt_to_page(const void *virt)
+{
+    return phys_to_page(virt_to_phys(virt));
+}
+
+/* Take another reference to an allocated frame */
+void page_get(page_t *page);
+
+/* Drop a reference; the frame goes back to the PMM when the last one is gone */
+void page_put(page_t *page);
+
+#endif /* PAGE_H */
@@ -4,13 +4,17 @@
  * Responsibilities:
  *  - declare PMM initialization and management functions
  *  - provide allocation and freeing of 4KB physical frames
+ *  - provide contiguous, aligned multi-frame allocation (DMA, huge pages)
+ *  - provide zone-aware allocation (DMA / DMA32 / NORMAL)
  *  - expose functions to query total and free frames
- *  - reserve space for page tables and early identity mapping
+ *  - define how much memory the boot page tables reach
  *  - provide diagnostic function to print PMM statistics
+ *  - keep a struct page for every frame (declared in page.h)
+ *  - serve pre-zeroed frames from a pool refilled at idle time
  * Notes:
  *  - PAGE_SIZE is fixed at 4KB
- *  - EARLY_IDENTITY_LIMIT defines the maximum address for early identity mapping
- *  - PT_RESERVE_BYTES reserves memory for page tables during early boot
+ *  - boot_map_limit is how much physical memory the boot page tables map
+ *    (identity and at PHYS_MAP_BASE) before the kernel page tables are live
  *  - pmm_init uses multiboot2 memory map to set up usable memory regions
  */
 
@@ -23,13 +27,36 @@
 
 #define PAGE_SIZE 4096ULL
 
-/* Early identity map from bootloader - typically 1 GiB */
-#define EARLY_IDENTITY_LIMIT (1ULL << 30)
+/* The PMM tracks frames in 128 MiB sections; only sections with RAM get a
+ * bitmap and frame descriptors (see memory/physical/page.h)
+ */
+#define PMM_SECTION_SHIFT 15ULL
+#define PMM_SECTION_FRAMES (1ULL << PMM_SECTION_SHIFT)
+
+/* Physical memory mapped by boot.S (identity and direct map): 512 GiB with
+ * 1 GiB pages, 1 GiB with the 2 MiB fallback. Set by boot.S.
+ */
+extern uint64_t boot_map_limit;
+
+/* Zone limits: legacy ISA DMA below 16 MiB, 32-bit DMA below 4 GiB */
+#define ZONE_DMA_LIMIT (16ULL * 1024 * 1024)
+#define ZONE_DMA32_LIMIT (4ULL * 1024 * 1024 * 1024)
+
+typedef enum
+{
+    PMM_ZONE_DMA = 0,
+    PMM_ZONE_DMA32 = 1,
+    PMM_ZONE_NORMAL = 2,
+    PMM_ZONE_COUNT
+} pmm_zone_id_t;
 
-/* Reserve space for page tables with 4KB pages
- * 64 MiB default reserve (tunable)
+/* Zone flags for the *_zone allocation functions.
+ * The flag names the highest zone allowed; allocation falls back
+ * NORMAL -> DMA32 -> DMA, skipping lower zones at their low watermark.
  */
-#define PT_RESERVE_BYTES (64ULL * 1024 * 1024)
+#define PMM_ALLOC_NORMAL 0x0U
+#define PMM_ALLOC_DMA32 0x1U
+#define PMM_ALLOC_DMA 0x2U
 
 /* Initialize the physical memory manager */
 void pmm_init(multiboot_size_tag *s);
@@ -42,9 +69,50 @@ uint64_t pmm_alloc_frame(void);
 /* Free a physical frame */
 void pmm_free_frame(uint64_t phys_addr);
 
+/* Allocate `count` physically contiguous frames whose base is aligned to
+ * `align` bytes (power of two, multiple of PAGE_SIZE; 0 means PAGE_SIZE).
+ * Returns physical address of the first frame or 0 on failure.
+ */
+uint64_t pmm_alloc_frames(uint64_t count, uint64_t align);
+
+/* Zone-aware variants of pmm_alloc_frame / pmm_alloc_frames (PMM_ALLOC_* flags).
+ * pmm_alloc_frame() and pmm_alloc_frames() are the PMM_ALLOC_NORMAL cases.
+ */
+uint64_t pmm_alloc_frame_zone(uint32_t flags);
+uint64_t pmm_alloc_frames_zone(uint64_t count, uint64_t align, uint32_t flags);
+
+/* Pre-zeroed frame pool watermarks: pmm_zero_pool_refill does nothing while
+ * the pool holds PMM_ZERO_POOL_LOW frames or more, else fills it to HIGH.
+ */
+#define PMM_ZERO_POOL_LOW 32U
+#define PMM_ZERO_POOL_HIGH 128U
+
+/* Allocate a zeroed frame (NORMAL zone), from the pool if it has one,
+ * else zeroed on the spot. Returns physical address or 0 on failure.
+ * Free it with pmm_free_frame as usual.
+ */
+uint64_t pmm_alloc_zeroed_frame(void);
+
+/* Top the zero pool up to PMM_ZERO_POOL_HIGH once it fell below LOW.
+ * Zeroing takes time: call it when idle, not on an allocation path.
+ */
+void pmm_zero_pool_refill(void);
+
+/* Frames currently in the zero pool */
+uint64_t pmm_zero_pool_frames(void);
+
+/* Print zero pool fill level and per-path allocation cost */
+void pmm_zero_pool_print_stats(void);
+
+/* Free `count` contiguous frames starting at phys_addr */
+void pmm_free_frames(uint64_t phys_addr, uint64_t count);
+
 /* Get number of free frames */
 uint64_t pmm_get_free_frames(void);
 
+/* Get number of free frames in one zone */
+uint64_t pmm_get_zone_free_frames(pmm_zone_id_t zone);
+
 /* Get total number of frames */
 uint64_t pmm_get_total_frames(void);
 
@@ -0,0 +1,75 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * tlb.h - TLB management and PCID-tagged address spaces for x86-64.
+ * Responsibilities:
+ *  - enable global pages (CR4.PGE) and PCIDs (CR4.PCIDE) when supported
+ *  - give each address space a PCID, recycled by generation
+ *  - switch CR3 without flushing a still-valid PCID's TLB entries
+ *  - invalidate one page, a range, one PCID or everything
+ * Notes:
+ *  - single CPU: there is no shootdown, only the local TLB is flushed
+ *  - PCID 0 (TLB_PCID_KERNEL) belongs to the kernel tables and is never
+ *    recycled; address spaces get PCIDs 1 .. TLB_PCID_MAX
+ *  - when the PCIDs run out, the generation is bumped, every PCID is flushed
+ *    once and address spaces pick up a new PCID on their next switch
+ *  - kernel mappings are global, so they survive switches and PCID flushes;
+ *    only tlb_flush_all drops them
+ *  - without PCID support, tlb_switch is a plain CR3 load
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+
+#define TLB_PCID_KERNEL 0U
+#define TLB_PCID_MAX 4095U
+
+/* Above this many pages, tlb_flush_range flushes the whole PCID instead */
+#define TLB_FLUSH_RANGE_THRESHOLD 32U
+
+/* Per address space PCID state; zero-initialize (TLB_ASID_INIT) */
+typedef struct tlb_asid
+{
+    uint64_t generation; /* generation pcid was assigned in, 0 = none */
+    uint16_t pcid;
+} tlb_asid_t;
+
+#define TLB_ASID_INIT {.generation = 0, .pcid = 0}
+
+/* Detect PGE / PCID / INVPCID and enable them.
+ * Must run after kernel_map_all (CR3[11:0] must be 0 to set CR4.PCIDE).
+ */
+void tlb_init(void);
+
+/* Load pml4_phys into CR3 tagged with asid's PCID (assigning a new one if
+ * asid's is stale). The PCID's TLB entries are kept when still valid.
+ */
+void tlb_switch(tlb_asid_t *asid, uint64_t pml4_phys);
+
+/* PCID currently in CR3 (TLB_PCID_KERNEL without PCID support) */
+uint16_t tlb_current_pcid(void);
+
+/* Invalidate the translation of virt in the current address space
+ * (global or not).
+ */
+void tlb_flush_page(uint64_t virt);
+
+/* Invalidate [start, end) in the current address space: per page up to
+ * TLB_FLUSH_RANGE_THRESHOLD pages, else the current PCID (user range) or
+ * everything (range reaching the kernel half).
+ */
+void tlb_flush_range(uint64_t start, uint64_t end);
+
+/* Invalidate all non-global translations tagged with pcid.
+ * Without INVPCID, a PCID other than the current one costs a full flush.
+ */
+void tlb_flush_pcid(uint16_t pcid);
+
+/* Invalidate every translation, global ones and all PCIDs included */
+void tlb_flush_all(void);
+
+/* Print TLB features and counters */
+void tlb_print_stats(void);
+
+#endif /* TLB_H */
@@ -0,0 +1,63 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * vmm.h - Virtual Memory Manager interface for x86-64.
+ * Responsibilities:
+ *  - declare map / unmap / protect over arbitrary page ranges
+ *  - define the mapping flags accepted by the VMM
+ *  - expose VMM initialization and diagnostic printing
+ * Notes:
+ *  - all sizes and addresses are in bytes and must be page aligned
+ *  - page-table pages come from the PMM and are freed once empty
+ *  - TLB invalidation is batched per call: one tlb_flush_page per changed
+ *    page up to VMM_INVLPG_THRESHOLD pages, tlb_flush_all beyond that
+ *    (see memory/virtual/tlb.h)
+ */
+
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory/physical/identity_map.h>
+
+/* Mapping flags (present is implied). VMM_PAT is moved to the large-page
+ * PAT bit automatically when a 2 MiB / 1 GiB entry is involved.
+ */
+#define VMM_WRITE PAGE_WRITE
+#define VMM_USER PAGE_USER
+#define VMM_PWT PAGE_PWT
+#define VMM_PCD PAGE_PCD
+#define VMM_PAT PAGE_PAT
+#define VMM_GLOBAL PAGE_GLOBAL
+#define VMM_NX PAGE_NX
+
+/* Above this many changed pages per call, flush the whole TLB instead */
+#define VMM_INVLPG_THRESHOLD 32U
+
+/* Take over the page tables currently loaded in CR3 and enable NX if available.
+ * Must run after pmm_init (which builds the kernel page tables).
+ */
+void vmm_init(void);
+
+/* Map [virt, virt + size) to [phys, phys + size) with 4 KiB pages.
+ * Fails without changing anything if any page in the range is already mapped.
+ * Returns 0 on success, -1 on error.
+ */
+int vmm_map(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags);
+
+/* Unmap [virt, virt + size); unmapped holes are skipped.
+ * Large pages only partly covered are split first. Empty tables are freed.
+ * Returns 0 on success, -1 on error.
+ */
+int vmm_unmap(uint64_t virt, uint64_t size);
+
+/* Replace the flags of every mapped page in [virt, virt + size).
+ * Unmapped holes are skipped; partly covered large pages are split.
+ * Returns 0 on success, -1 on error.
+ */
+int vmm_protect(uint64_t virt, uint64_t size, uint64_t flags);
+
+/* Print VMM counters (tables, pages, TLB flushes) */
+void vmm_print_stats(void);
+
+#endif /* VMM_H */
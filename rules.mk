@@ -16,5 +16,18 @@ PROJECT_ROOT := $(abspath $(dir $(lastword $(MAKEFILE_LIST))))
 INCLUDE_FLAGS := -I$(PROJECT_ROOT)/include
 
 # Compiler flags
-CFLAGS = -std=gnu99 -ffreestanding -O2 -Wall -Wextra -mno-red-zone -mcmodel=kernel $(INCLUDE_FLAGS)
+# -mgeneral-regs-only: no SSE/x87 code outside kernel_fpu_begin/end regions (lib/fpu.h)
+CFLAGS = -std=gnu99 -ffreestanding -O2 -Wall -Wextra -mno-red-zone -mcmodel=kernel -mgeneral-regs-only $(INCLUDE_FLAGS)
 ASFLAGS = --64
+
+# Physical memory backend: bitmap (default) or buddy
+PMM_BACKEND ?= bitmap
+ifeq ($(PMM_BACKEND),buddy)
+CFLAGS += -DPMM_BACKEND_BUDDY
+endif
+
+# Boot-time benchmarks (src/bench.c): off by default
+BENCH ?= 0
+ifeq ($(BENCH),1)
+CFLAGS += -DURIX_BENCH
+endif
@@ -0,0 +1,225 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * bench.c - Boot-time benchmarks (built with BENCH=1).
+ * Responsibilities:
+ *  - time page-table creation with and without the zero pool
+ *  - time the mem* family, normal and streaming, from 8 B to 1 MiB
+ *  - time kmalloc / kfree and a named cache against the frame allocator
+ * Notes:
+ *  - runs from kernel_main once the heap is up, before bootmem_release;
+ *    everything a benchmark allocates is freed again
+ *  - not part of a normal build: the benchmarks touch a lot of memory and
+ *    print several screens of results
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <bench.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/tsc.h>
+#include <lib/string.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+#include <memory/virtual/vmm.h>
+#include <memory/heap/slab.h>
+
+/* Page-table creation benchmark: each mapping lands in its own 1 GiB slot of
+ * an unused upper-half PML4 slot, so it needs a new PD and PT.
+ */
+#define PT_BENCH_BASE 0xFFFFC00000000000ULL
+#define PT_BENCH_MAPPINGS 32U
+
+static uint64_t __init pt_bench_run(uint64_t phys)
+{
+    uint64_t start = rdtsc();
+
+    for (unsigned i = 0; i < PT_BENCH_MAPPINGS; i++)
+        vmm_map(PT_BENCH_BASE + (uint64_t)i * 0x40000000ULL, phys, PAGE_SIZE, VMM_WRITE);
+
+    uint64_t cycles = rdtsc() - start;
+    vmm_unmap(PT_BENCH_BASE, (uint64_t)PT_BENCH_MAPPINGS * 0x40000000ULL);
+    return cycles;
+}
+
+/*
+ * times page-table creation with tables from the zero pool, then with the
+ * pool drained so every table is zeroed inline.
+ */
+static void __init pt_bench(void)
+{
+    uint64_t drained[PMM_ZERO_POOL_HIGH];
+    uint64_t n = 0;
+    uint64_t phys = pmm_alloc_frame();
+
+    if (!phys)
+        return;
+
+    pmm_zero_pool_refill();
+    uint64_t pooled = pt_bench_run(phys);
+
+    while (pmm_zero_pool_frames() && n < PMM_ZERO_POOL_HIGH)
+        drained[n++] = pmm_alloc_zeroed_frame();
+    uint64_t inline_zeroed = pt_bench_run(phys);
+
+    while (n)
+        pmm_free_frame(drained[--n]);
+    pmm_free_frame(phys);
+    pmm_zero_pool_refill();
+
+    kprintf("PT bench: %u mappings (%u tables): %llu cycles from zero pool, %llu zeroing inline\n",
+            PT_BENCH_MAPPINGS, 2 * PT_BENCH_MAPPINGS + 1, pooled, inline_zeroed);
+}
+
+/* mem* benchmark over sizes 8 B .. 1 MiB, each size repeated until about
+ * MEM_BENCH_BYTES were processed
+ */
+#define MEM_BENCH_MAX (1024U * 1024U)
+#define MEM_BENCH_BYTES (4U * 1024U * 1024U)
+
+/* Prints cycles / byte with two decimals */
+static void __init mem_bench_print(const char *name, uint64_t cycles, uint64_t bytes)
+{
+    uint64_t cpb = cycles * 100 / bytes;
+    kprintf(" %s %llu.%llu%llu", name, cpb / 100, (cpb / 10) % 10, cpb % 10);
+}
+
+/*
+ * prints cycles per byte of memset, memcpy, memcmp and the streaming
+ * variants for power-of-8 sizes.
+ */
+static void __init mem_bench(void)
+{
+    uint64_t buf = pmm_alloc_frames(2 * MEM_BENCH_MAX / PAGE_SIZE, 0);
+    if (!buf)
+        return;
+
+    unsigned char *a = (unsigned char *)phys_to_virt(buf);
+    unsigned char *b = a + MEM_BENCH_MAX;
+    volatile int sink = 0;
+
+    memset(a, 0x5A, MEM_BENCH_MAX);
+    memset(b, 0x5A, MEM_BENCH_MAX);
+    kprintf("mem bench (cycles/byte):\n");
+
+    for (uint64_t n = 8; n <= MEM_BENCH_MAX; n *= 8)
+    {
+        uint64_t iters = MEM_BENCH_BYTES / n;
+        uint64_t bytes = iters * n;
+        uint64_t t;
+
+        kprintf("  %llu B:", n);
+
+        t = rdtsc();
+        for (uint64_t i = 0; i < iters; i++)
+            memset(a, (int)i, n);
+        mem_bench_print("memset", rdtsc() - t, bytes);
+
+        t = rdtsc();
+        for (uint64_t i = 0; i < iters; i++)
+            memcpy(b, a, n);
+        mem_bench_print("memcpy", rdtsc() - t, bytes);
+
+        t = rdtsc();
+        for (uint64_t i = 0; i < iters; i++)
+            sink += memcmp(a, b, n);
+        mem_bench_print("memcmp", rdtsc() - t, bytes);
+
+        if (n >= MEM_NT_MIN)
+        {
+            t = rdtsc();
+            for (uint64_t i = 0; i < iters; i++)
+                memset_nt(a, (int)i, n);
+            mem_bench_print("memset_nt", rdtsc() - t, bytes);
+
+            t = rdtsc();
+            for (uint64_t i = 0; i < iters; i++)
+                memcpy_nt(b, a, n);
+            mem_bench_print("memcpy_nt", rdtsc() - t, bytes);
+        }
+        kprintf("\n");
+    }
+
+    (void)sink;
+    pmm_free_frames(buf, 2 * MEM_BENCH_MAX / PAGE_SIZE);
+}
+
+/* Slab benchmark: cycles per kmalloc / kfree over SLAB_BENCH_OBJECTS live
+ * objects, then a hot alloc+free pair, against pmm_alloc_frame / free
+ */
+#define SLAB_BENCH_OBJECTS 1024U
+
+static void *slab_bench_objs[SLAB_BENCH_OBJECTS];
+
+static void __init slab_bench_ctor(void *obj)
+{
+    memset(obj, 0, 40);
+}
+
+static void __init slab_bench(void)
+{
+    static const size_t sizes[] = {32, 256, 2048, 16384};
+    uint64_t t, alloc, release;
+
+    kprintf("slab bench (cycles/op, %u objects):\n", SLAB_BENCH_OBJECTS);
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        t = rdtsc();
+        for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+            slab_bench_objs[i] = kmalloc(sizes[s]);
+        alloc = rdtsc() - t;
+
+        t = rdtsc();
+        for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+            kfree(slab_bench_objs[i]);
+        release = rdtsc() - t;
+
+        t = rdtsc();
+        for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+            kfree(kmalloc(sizes[s]));
+
+        kprintf("  %llu B: kmalloc %llu, kfree %llu, pair %llu\n", (uint64_t)sizes[s],
+                alloc / SLAB_BENCH_OBJECTS, release / SLAB_BENCH_OBJECTS,
+                (rdtsc() - t) / SLAB_BENCH_OBJECTS);
+    }
+
+    kmem_cache_t *cache = kmem_cache_create("bench-40", 40, 0, slab_bench_ctor);
+    if (cache)
+    {
+        t = rdtsc();
+        for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+            slab_bench_objs[i] = kmem_cache_alloc(cache);
+        alloc = rdtsc() - t;
+
+        t = rdtsc();
+        for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+            kmem_cache_free(cache, slab_bench_objs[i]);
+        release = rdtsc() - t;
+
+        kprintf("  bench-40 (ctor): alloc %llu, free %llu\n",
+                alloc / SLAB_BENCH_OBJECTS, release / SLAB_BENCH_OBJECTS);
+        kmem_cache_destroy(cache);
+    }
+
+    t = rdtsc();
+    for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+        slab_bench_objs[i] = (void *)(uintptr_t)pmm_alloc_frame();
+    alloc = rdtsc() - t;
+
+    t = rdtsc();
+    for (unsigned i = 0; i < SLAB_BENCH_OBJECTS; i++)
+        pmm_free_frame((uint64_t)(uintptr_t)slab_bench_objs[i]);
+    release = rdtsc() - t;
+
+    kprintf("  reference: pmm_alloc_frame %llu, pmm_free_frame %llu\n",
+            alloc / SLAB_BENCH_OBJECTS, release / SLAB_BENCH_OBJECTS);
+    kmem_print_stats();
+}
+
+void __init kernel_bench(void)
+{
+    pt_bench();
+    mem_bench();
+    slab_bench();
+}
@@ -0,0 +1,190 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * serial.c - 16550 UART (COM1) console driver implementation.
+ * Responsibilities:
+ *  - program COM1: 115200 baud, 8N1, FIFOs on, loopback presence test
+ *  - queue output in a transmit ring, send it in FIFO-sized bursts
+ *  - pump the ring without waiting: a flush sends one burst if the UART
+ *    can take it and returns
+ * Notes:
+ *  - single producer (the log drain); bursts are sent from serial_flush
+ *    (log drain, idle loop) or by a writer that finds the ring full, always
+ *    with interrupts off, so two pumps never overlap
+ *  - when THR is empty the whole transmit FIFO is empty, so a burst is up
+ *    to tx_fifo bytes (16 on a 16550A, 1 on an 8250 / 16450)
+ *  - polled only: there is no IDT yet to route IRQ 4 to a THRE handler,
+ *    so what a flush leaves queued goes out on the next flush
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <drivers/serial.h>
+#include <lib/io.h>
+#include <lib/print.h>
+
+// registers (offsets from SERIAL_COM1)
+#define UART_THR 0 // transmit holding (DLAB = 0)
+#define UART_DLL 0 // divisor low (DLAB = 1)
+#define UART_IER 1 // interrupt enable (DLAB = 0)
+#define UART_DLM 1 // divisor high (DLAB = 1)
+#define UART_IIR 2 // interrupt identification (read)
+#define UART_FCR 2 // FIFO control (write)
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define FCR_ENABLE_CLEAR 0x07 // enable FIFOs, clear RX and TX
+#define MCR_DTR_RTS_OUT2 0x0B // OUT2 gates the IRQ line
+#define MCR_LOOPBACK 0x1E
+#define IIR_FIFO_ON 0xC0
+#define LSR_THRE 0x20
+
+#define UART_CLOCK 115200U
+#define UART_FIFO_BYTES 16U
+#define RFLAGS_IF (1ULL << 9)
+
+static char tx_ring[SERIAL_TX_BYTES];
+static uint32_t tx_head = 0; // next byte to queue (free-running)
+static uint32_t tx_tail = 0; // next byte to send (free-running)
+static unsigned tx_fifo = 1; // bytes per burst
+static int present = 0;
+
+static inline uint8_t uart_in(unsigned reg)
+{
+    return inb((uint16_t)(SERIAL_COM1 + reg));
+}
+
+static inline void uart_out(unsigned reg, uint8_t v)
+{
+    outb((uint16_t)(SERIAL_COM1 + reg), v);
+}
+
+static inline uint64_t irq_save(void)
+{
+    uint64_t flags;
+    __asm__ volatile("pushfq\n\t"
+                     "popq %0\n\t"
+                     "cli"
+                     : "=r"(flags)
+                     :
+                     : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags)
+{
+    if (flags & RFLAGS_IF)
+        __asm__ volatile("sti" ::: "memory");
+}
+
+/* Move one burst from the ring to the FIFO if the transmitter is empty.
+ * Interrupts must be off. Returns the bytes sent.
+ */
+static unsigned tx_burst(void)
+{
+    if (!(uart_in(UART_LSR) & LSR_THRE))
+        return 0;
+
+    unsigned n = 0;
+    uint32_t head = __atomic_load_n(&tx_head, __ATOMIC_ACQUIRE);
+
+    while (n < tx_fifo && tx_tail != head)
+    {
+        uart_out(UART_THR, (uint8_t)tx_ring[tx_tail & (SERIAL_TX_BYTES - 1)]);
+        tx_tail++;
+        n++;
+    }
+    __atomic_store_n(&tx_tail, tx_tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* Wait for the transmitter and send one burst */
+static void tx_burst_wait(void)
+{
+    uint64_t flags = irq_save();
+
+    while (!(uart_in(UART_LSR) & LSR_THRE))
+        __asm__ volatile("pause");
+    tx_burst();
+
+    irq_restore(flags);
+}
+
+static void tx_queue(char c)
+{
+    // full: send a burst ourselves rather than drop
+    while (tx_head - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE) == SERIAL_TX_BYTES)
+        tx_burst_wait();
+
+    tx_ring[tx_head & (SERIAL_TX_BYTES - 1)] = c;
+    __atomic_store_n(&tx_head, tx_head + 1, __ATOMIC_RELEASE);
+}
+
+int serial_init(void)
+{
+    uint16_t divisor = (uint16_t)(UART_CLOCK / SERIAL_BAUD);
+
+    uart_out(UART_IER, 0);
+    uart_out(UART_LCR, LCR_DLAB);
+    uart_out(UART_DLL, (uint8_t)divisor);
+    uart_out(UART_DLM, (uint8_t)(divisor >> 8));
+    uart_out(UART_LCR, LCR_8N1);
+    uart_out(UART_FCR, FCR_ENABLE_CLEAR);
+
+    // loopback: a byte sent must come back unchanged
+    uart_out(UART_MCR, MCR_LOOPBACK);
+    uart_out(UART_THR, 0xAE);
+    if (uart_in(UART_THR) != 0xAE)
+    {
+        kprintf("serial_init: ERROR - no UART at %x\n", SERIAL_COM1);
+        return -1;
+    }
+
+    uart_out(UART_MCR, MCR_DTR_RTS_OUT2);
+
+    tx_fifo = (uart_in(UART_IIR) & IIR_FIFO_ON) == IIR_FIFO_ON ? UART_FIFO_BYTES : 1;
+    present = 1;
+
+    kprintf("serial_init: COM1 at %u baud, %u-byte transmit FIFO\n", SERIAL_BAUD, tx_fifo);
+    return 0;
+}
+
+void serial_write(const char *data, size_t len)
+{
+    if (!present)
+        return;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] == '\n')
+            tx_queue('\r');
+        tx_queue(data[i]);
+    }
+}
+
+void serial_flush(void)
+{
+    if (!present)
+        return;
+
+    // at most one burst: a busy transmitter is left to the next flush
+    uint64_t flags = irq_save();
+    tx_burst();
+    irq_restore(flags);
+}
+
+size_t serial_pending(void)
+{
+    if (!present)
+        return 0;
+
+    return __atomic_load_n(&tx_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE);
+}
+
+console_sink_t serial_console_sink = {
+    .name = "serial",
+    .write = serial_write,
+    .flush = serial_flush,
+};
@@ -2,25 +2,112 @@
  * Licensed under MIT License - URIX project.
  * vga.c - VGA text-mode driver implementation.
  * Responsibilities:
- *  - manage VGA text buffer at 0xB8000
+ *  - keep the console contents in a RAM shadow of the text buffer
  *  - handle colors, and screen state
  *  - provide character, string, and buffer output functions
  *  - support special characters (\n, \r, \t) and scrolling
+ *  - copy dirty rows to the VGA text buffer at 0xB8000 (through the direct map)
+ *  - scroll in hardware and move the hardware cursor (CRTC registers)
+ *  - act as a console sink for the log ring (vga_console_sink)
  * Notes:
  *  - operates in 80x25 text mode (VGA_WIDTH x VGA_HEIGHT)
- *  - uses global console state (row, column, color, buffer)
- *  - scrolling implemented by shifting lines up in buffer
+ *  - uses global console state (row, column, color, shadow)
+ *  - the shadow is a ring of rows: scrolling moves the index of the top row
+ *    and clears one row, nothing is copied
+ *  - the text buffer is uncached MMIO and is never read; it is only written,
+ *    a whole row at a time with 8-byte stores, by console_flush
+ *  - the text buffer holds VGA_TEXT_ROWS rows, the screen shows VGA_HEIGHT
+ *    of them starting at hw_top (CRTC start address). A scroll moves hw_top
+ *    down one row, so only the new bottom row is written; once the window
+ *    reaches the end of the buffer it moves back to row 0 and the whole
+ *    screen is written once (every ~8 screens of output)
  */
 
 
 #include <drivers/vga.h>
 #include <lib/string.h>
+#include <lib/io.h>
+#include <memory/layout.h>
+
+#define VGA_ALL_ROWS ((1U << VGA_HEIGHT) - 1)
+
+// rows of VGA_WIDTH cells in the 32 KiB text buffer
+#define VGA_TEXT_ROWS (0x8000 / 2 / VGA_WIDTH)
+
+// CRT controller (color adapter ports)
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define CRTC_CURSOR_START 0x0A
+#define CRTC_CURSOR_END 0x0B
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
 
 // state
 static size_t console_row = 0;
 static size_t console_column = 0;
 static uint8_t console_color = 0;
-static volatile uint16_t *console_buffer = (volatile uint16_t *)VGA_MEMORY;
+static volatile uint64_t *console_buffer = (volatile uint64_t *)(PHYS_MAP_BASE + VGA_MEMORY);
+
+// 4 cells at a time; may_alias because the shadow is declared as uint16_t
+typedef uint64_t __attribute__((may_alias)) vga_quad_t;
+
+// shadow: screen row y is shadow[(shadow_top + y) % VGA_HEIGHT]
+static uint16_t shadow[VGA_HEIGHT][VGA_WIDTH] __attribute__((aligned(8)));
+static size_t shadow_top = 0;
+static uint32_t dirty_rows = 0; // bit y: screen row y differs from the text buffer
+
+// hardware window: screen row y is text buffer row hw_top + y
+static size_t hw_top = 0;
+static size_t crtc_start = (size_t)-1;  // start address last written to the CRTC
+static size_t crtc_cursor = (size_t)-1; // cursor position last written to the CRTC
+
+/**
+ * crtc_write16 - write a 16-bit value to the CRTC register pair high/high+1
+ */
+static void crtc_write16(uint8_t high, uint16_t value)
+{
+    outb(CRTC_INDEX, high);
+    outb(CRTC_DATA, (uint8_t)(value >> 8));
+    outb(CRTC_INDEX, high + 1);
+    outb(CRTC_DATA, (uint8_t)value);
+}
+
+/**
+ * cursor_enable - show the hardware cursor as an underline
+ */
+static void cursor_enable(void)
+{
+    outb(CRTC_INDEX, CRTC_CURSOR_START);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xC0) | 14);
+    outb(CRTC_INDEX, CRTC_CURSOR_END);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xE0) | 15);
+}
+
+/**
+ * shadow_row - shadow storage of screen row y
+ */
+static inline uint16_t *shadow_row(size_t y)
+{
+    size_t i = shadow_top + y;
+    if (i >= VGA_HEIGHT)
+        i -= VGA_HEIGHT;
+    return shadow[i];
+}
+
+/**
+ * clear_row - fill screen row y with blanks in the current color
+ */
+static void clear_row(size_t y)
+{
+    uint16_t *row = shadow_row(y);
+    uint16_t blank = vga_entry(' ', console_color);
+
+    for (size_t x = 0; x < VGA_WIDTH; x++)
+        row[x] = blank;
+    dirty_rows |= 1U << y;
+}
 
 /**
  * vga_entry_color - combine fg/bg colors into one byte
@@ -46,14 +133,15 @@ void console_initialize(void)
     console_row = 0;
     console_column = 0;
     console_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
+    shadow_top = 0;
+    hw_top = 0;
+    crtc_start = crtc_cursor = (size_t)-1;
+    cursor_enable();
 
     for (size_t y = 0; y < VGA_HEIGHT; y++)
-    {
-        for (size_t x = 0; x < VGA_WIDTH; x++)
-        {
-            console_buffer[y * VGA_WIDTH + x] = vga_entry(' ', console_color);
-        }
-    }
+        clear_row(y);
+
+    console_flush();
 }
 
 /**
@@ -69,7 +157,8 @@ void console_set_color(uint8_t color)
  */
 void console_putentryat(char c, uint8_t color, size_t x, size_t y)
 {
-    console_buffer[y * VGA_WIDTH + x] = vga_entry(c, color);
+    shadow_row(y)[x] = vga_entry(c, color);
+    dirty_rows |= 1U << y;
 }
 
 /**
@@ -77,17 +166,56 @@ void console_putentryat(char c, uint8_t color, size_t x, size_t y)
  */
 void console_scroll_up(void)
 {
-    for (size_t y = 0; y < VGA_HEIGHT - 1; y++)
+    // the old top row becomes the new bottom row
+    if (++shadow_top == VGA_HEIGHT)
+        shadow_top = 0;
+
+    // pan the window down; the rows above the new bottom are already there,
+    // and pending changes move up with their rows
+    dirty_rows >>= 1;
+    clear_row(VGA_HEIGHT - 1);
+
+    if (++hw_top + VGA_HEIGHT > VGA_TEXT_ROWS)
     {
-        for (size_t x = 0; x < VGA_WIDTH; x++)
-        {
-            console_buffer[y * VGA_WIDTH + x] = console_buffer[(y + 1) * VGA_WIDTH + x];
-        }
+        hw_top = 0;
+        dirty_rows = VGA_ALL_ROWS;
     }
+}
 
-    for (size_t x = 0; x < VGA_WIDTH; x++)
+/**
+ * console_flush - copy dirty rows to the text buffer, then move the
+ * window and the cursor
+ */
+void console_flush(void)
+{
+    uint32_t dirty = dirty_rows;
+    dirty_rows = 0;
+
+    while (dirty)
     {
-        console_buffer[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = vga_entry(' ', console_color);
+        size_t y = (size_t)__builtin_ctz(dirty);
+        const vga_quad_t *src = (const vga_quad_t *)shadow_row(y);
+        volatile uint64_t *dst = console_buffer + (hw_top + y) * (VGA_WIDTH / 4);
+
+        for (size_t i = 0; i < VGA_WIDTH / 4; i++)
+            dst[i] = src[i];
+
+        dirty &= dirty - 1;
+    }
+
+    // rows are in place before the window shows them
+    size_t start = hw_top * VGA_WIDTH;
+    if (start != crtc_start)
+    {
+        crtc_write16(CRTC_START_HIGH, (uint16_t)start);
+        crtc_start = start;
+    }
+
+    size_t cursor = start + console_row * VGA_WIDTH + console_column;
+    if (cursor != crtc_cursor)
+    {
+        crtc_write16(CRTC_CURSOR_HIGH, (uint16_t)cursor);
+        crtc_cursor = cursor;
     }
 }
 
@@ -131,12 +259,14 @@ void console_putchar(char c)
 }
 
 /**
- * console_write - write buffer of size N
+ * console_write - write buffer of size N, then flush
  */
 void console_write(const char *data, size_t size)
 {
     for (size_t i = 0; i < size; i++)
         console_putchar(data[i]);
+
+    console_flush();
 }
 
 /**
@@ -162,3 +292,18 @@ void console_puts(const char *str)
 {
     console_writestring(str);
 }
+
+/**
+ * vga_sink_write - log ring output; shown at the sink's flush
+ */
+static void vga_sink_write(const char *text, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        console_putchar(text[i]);
+}
+
+console_sink_t vga_console_sink = {
+    .name = "vga",
+    .write = vga_sink_write,
+    .flush = console_flush,
+};
@@ -2,13 +2,20 @@
  * kernel.c
  *
  * Responsibilities:
+ *  - Attach the consoles (VGA, COM1 serial) to the kernel log
  *  - Initialize the physical memory manager (pmm)
+ *  - Initialize the virtual memory manager (vmm) and the TLB layer
+ *  - Initialize the kernel heap (slab allocator)
+ *  - Release boot-only memory (bootmem arena tail, __init section)
+ *  - Idle: refill the zero pool, send queued serial output
  *
  * Notes:
  *  - GRUB passes the Multiboot2 info pointer as the first argument to
  *    kernel_main (RDI) because boot.S calls `kernel_main(mb_info_ptr)`.
- *  - boot.S creates identity mapping for low memory (first 1 GiB),
- *    so we can read/write low memory here. See boot.S for details.
+ *  - The kernel runs in the higher half; the multiboot pointer is physical
+ *    and is read through the direct map (phys_to_virt). boot.S maps the
+ *    first 512 GiB there (1 GiB without 1 GiB page support) until pmm_init
+ *    installs the full kernel page tables.
  */
 
 #include <stdarg.h>
@@ -16,16 +23,38 @@
 #include <stddef.h>
 
 #include <lib/print.h>
+#include <lib/init.h>
 #include <lib/logo.h> 
+#include <lib/string.h>
+#include <lib/fpu.h>
+#include <lib/cpu_features.h>
+#include <lib/alternatives.h>
+#include <drivers/serial.h>
+#include <memory/layout.h>
 #include <memory/physical/pmm.h>
-
+#include <memory/physical/bootmem.h>
+#include <memory/virtual/vmm.h>
+#include <memory/virtual/tlb.h>
+#include <memory/heap/slab.h>
+#include <bench.h>
 
 void kernel_main(uint64_t mb_info_addr)
 {
-    multiboot_size_tag *tag = (multiboot_size_tag *)(uintptr_t)(mb_info_addr);
+    multiboot_size_tag *tag = (multiboot_size_tag *)phys_to_virt(mb_info_addr);
+    cpu_features_init();
     clear_screen();
+    log_register_sink(&vga_console_sink);
+    if (serial_init() == 0)
+        log_register_sink(&serial_console_sink);
     print_logo();
+    cpu_features_print();
+    fpu_init();
+    alternatives_apply();
+    string_init();
     pmm_init(tag);
+    vmm_init();
+    tlb_init();
+    slab_init();
     uint64_t frame = pmm_alloc_frame();
     kprintf("Free frames: %llx\n", pmm_get_free_frames);
     uint64_t frame2 = pmm_alloc_frame();
@@ -33,10 +62,22 @@ void kernel_main(uint64_t mb_info_addr)
     pmm_free_frame(frame2);
     kprintf("Free frames: %llx\n", pmm_get_free_frames);
     pmm_free_frame(frame);
+#ifdef URIX_BENCH
+    kernel_bench();
+#endif
+
+    /* End of initialization: nothing __init may run after this */
+    bootmem_release();
 
     /* Halt CPU: change this later to run more kernel code */
     for (;;)
     {
+        pmm_zero_pool_refill();
+
+        /* No serial interrupt yet: send the queued console output now */
+        while (serial_pending())
+            serial_flush();
+
         __asm__ volatile("hlt");
     }
 }
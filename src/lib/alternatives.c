@@ -0,0 +1,76 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * alternatives.c - Apply the .alt_jumps table.
+ * Responsibilities:
+ *  - pick the best available target for every jump site
+ *  - rewrite the site's rel32 displacement
+ * Notes:
+ *  - writes go through the direct-map alias of the site, so patching keeps
+ *    working once kernel text is mapped read-only
+ *  - sites and targets are both in the kernel image (top 2 GiB), so any
+ *    displacement fits in 32 bits
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpu_features.h>
+#include <lib/alternatives.h>
+#include <memory/layout.h>
+
+#define JMP_REL32 0xE9
+#define JMP_REL32_LEN 5
+
+extern alt_jump_t __alt_jumps_start[];
+extern alt_jump_t __alt_jumps_end[];
+
+/* Point the jmp at site to target */
+static void __init patch_jump(uint8_t *site, const void *target)
+{
+    int32_t rel = (int32_t)((intptr_t)target - (intptr_t)(site + JMP_REL32_LEN));
+    uint8_t *alias = (uint8_t *)phys_to_virt(virt_to_phys(site));
+
+    /* One aligned 4-byte store would be atomic, but nothing runs concurrently */
+    for (unsigned i = 0; i < 4; i++)
+        alias[1 + i] = (uint8_t)((uint32_t)rel >> (8 * i));
+}
+
+/* Returns 1 if an earlier entry already patched this site */
+static int __init site_done(const alt_jump_t *entry)
+{
+    for (const alt_jump_t *e = __alt_jumps_start; e < entry; e++)
+    {
+        if (e->site == entry->site && cpu_has(e->feature))
+            return 1;
+    }
+    return 0;
+}
+
+void __init alternatives_apply(void)
+{
+    unsigned patched = 0, total = 0;
+
+    for (alt_jump_t *e = __alt_jumps_start; e < __alt_jumps_end; e++)
+    {
+        total++;
+
+        if (e->site[0] != JMP_REL32)
+        {
+            kprintf("alternatives_apply: ERROR - site %llx is not a jmp rel32\n",
+                    (uint64_t)(uintptr_t)e->site);
+            continue;
+        }
+
+        if (!cpu_has(e->feature) || site_done(e))
+            continue;
+
+        patch_jump(e->site, e->target);
+        patched++;
+    }
+
+    /* Serialize so the new displacements are fetched (cpuid is serializing) */
+    __asm__ volatile("cpuid" : : "a"(0) : "rbx", "rcx", "rdx", "memory");
+
+    kprintf("alternatives_apply: %u of %u alternatives applied\n", patched, total);
+}
@@ -0,0 +1,145 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * cpu_features.c - One-time CPUID parsing.
+ * Responsibilities:
+ *  - read vendor, family / model and the feature leaves into cpu_features
+ *  - drop features the OS has not enabled (AVX without YMM state in XCR0)
+ *  - print what was found
+ * Notes:
+ *  - missing leaves leave their words zero, so every feature reads as absent
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpuid.h>
+#include <lib/cpu_regs.h>
+#include <lib/cpu_features.h>
+
+cpu_features_t cpu_features;
+
+static const struct
+{
+    unsigned feature;
+    const char *name;
+} feature_names[] = {
+    {X86_FEATURE_PGE, "pge"},
+    {X86_FEATURE_PAT, "pat"},
+    {X86_FEATURE_SSE2, "sse2"},
+    {X86_FEATURE_SSE4_2, "sse4_2"},
+    {X86_FEATURE_POPCNT, "popcnt"},
+    {X86_FEATURE_PCID, "pcid"},
+    {X86_FEATURE_X2APIC, "x2apic"},
+    {X86_FEATURE_TSC_DEADLINE, "tsc_deadline"},
+    {X86_FEATURE_XSAVE, "xsave"},
+    {X86_FEATURE_AVX, "avx"},
+    {X86_FEATURE_AVX2, "avx2"},
+    {X86_FEATURE_BMI2, "bmi2"},
+    {X86_FEATURE_ERMS, "erms"},
+    {X86_FEATURE_FSRM, "fsrm"},
+    {X86_FEATURE_INVPCID, "invpcid"},
+    {X86_FEATURE_SMEP, "smep"},
+    {X86_FEATURE_SMAP, "smap"},
+    {X86_FEATURE_RDRAND, "rdrand"},
+    {X86_FEATURE_NX, "nx"},
+    {X86_FEATURE_PDPE1GB, "pdpe1gb"},
+    {X86_FEATURE_RDTSCP, "rdtscp"},
+    {X86_FEATURE_INVARIANT_TSC, "invariant_tsc"},
+    {X86_FEATURE_HYPERVISOR, "hypervisor"},
+};
+
+static void clear_feature(unsigned feature)
+{
+    cpu_features.words[feature / 32] &= ~(1U << (feature % 32));
+}
+
+static void __init read_vendor(void)
+{
+    uint32_t a, b, c, d;
+
+    cpuid(0, 0, &a, &b, &c, &d);
+    cpu_features.max_leaf = a;
+
+    /* The vendor string is EBX, EDX, ECX in that order */
+    uint32_t regs[3] = {b, d, c};
+    for (unsigned i = 0; i < 12; i++)
+        cpu_features.vendor[i] = (char)(regs[i / 4] >> (8 * (i % 4)));
+    cpu_features.vendor[12] = '\0';
+}
+
+static void __init read_signature(uint32_t eax)
+{
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+
+    if (family == 0xF)
+        family += (eax >> 20) & 0xFF;
+    if (family == 0x6 || family >= 0xF)
+        model |= ((eax >> 16) & 0xF) << 4;
+
+    cpu_features.family = family;
+    cpu_features.model = model;
+    cpu_features.stepping = eax & 0xF;
+}
+
+void __init cpu_features_init(void)
+{
+    uint32_t a, b, c, d;
+    uint32_t *w = cpu_features.words;
+
+    read_vendor();
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    read_signature(a);
+    w[CPU_WORD_1_EDX] = d;
+    w[CPU_WORD_1_ECX] = c;
+
+    if (cpu_features.max_leaf >= 7)
+    {
+        cpuid(7, 0, &a, &b, &c, &d);
+        w[CPU_WORD_7_EBX] = b;
+        w[CPU_WORD_7_ECX] = c;
+        w[CPU_WORD_7_EDX] = d;
+    }
+
+    cpuid(0x80000000U, 0, &a, &b, &c, &d);
+    cpu_features.max_ext_leaf = a >= 0x80000000U ? a : 0;
+
+    if (cpu_features.max_ext_leaf >= 0x80000001U)
+    {
+        cpuid(0x80000001U, 0, &a, &b, &c, &d);
+        w[CPU_WORD_EXT1_EDX] = d;
+        w[CPU_WORD_EXT1_ECX] = c;
+    }
+
+    if (cpu_features.max_ext_leaf >= 0x80000007U)
+    {
+        cpuid(0x80000007U, 0, &a, &b, &c, &d);
+        w[CPU_WORD_EXT7_EDX] = d;
+    }
+
+    /* boot.S enables the YMM state only when it can; without it AVX faults */
+    uint64_t xcr0 = cpu_has(X86_FEATURE_OSXSAVE) ? xgetbv(0) : 0;
+    if ((xcr0 & (XCR0_SSE | XCR0_AVX)) != (XCR0_SSE | XCR0_AVX))
+    {
+        clear_feature(X86_FEATURE_AVX);
+        clear_feature(X86_FEATURE_AVX2);
+        clear_feature(X86_FEATURE_FMA);
+    }
+}
+
+void __init cpu_features_print(void)
+{
+    kprintf("CPU: %s family %u model %u stepping %u, max leaf %x / %x\n",
+            cpu_features.vendor, cpu_features.family, cpu_features.model,
+            cpu_features.stepping, cpu_features.max_leaf, cpu_features.max_ext_leaf);
+
+    kprintf("CPU features:");
+    for (size_t i = 0; i < sizeof(feature_names) / sizeof(feature_names[0]); i++)
+    {
+        if (cpu_has(feature_names[i].feature))
+            kprintf(" %s", feature_names[i].name);
+    }
+    kprintf("\n");
+}
@@ -0,0 +1,70 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * fpu.c - Kernel SIMD state and region bracketing.
+ * Responsibilities:
+ *  - pick the SIMD level from CPUID and XCR0
+ *  - implement kernel_fpu_begin / kernel_fpu_end
+ * Notes:
+ *  - AVX2 needs the CPU feature and the YMM state enabled in XCR0 (which
+ *    boot.S sets when the CPU has XSAVE and AVX); cpu_features checks both
+ *  - runs after cpu_features_init
+ *  - begin saves RFLAGS.IF on the outermost level only; end restores it
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpu_features.h>
+#include <lib/cpu_regs.h>
+#include <lib/fpu.h>
+
+#define RFLAGS_IF (1ULL << 9)
+
+static fpu_simd_t simd_level = FPU_SIMD_NONE;
+static unsigned fpu_depth = 0;
+static uint64_t fpu_saved_flags = 0;
+
+void __init fpu_init(void)
+{
+    uint64_t xcr0 = cpu_has(X86_FEATURE_OSXSAVE) ? xgetbv(0) : 0;
+
+    /* cpu_features already dropped AVX2 if XCR0 lacks the YMM state */
+    simd_level = cpu_has(X86_FEATURE_AVX2) ? FPU_SIMD_AVX2 : FPU_SIMD_SSE2;
+
+    kprintf("fpu_init: SSE2 enabled, XSAVE %s, XCR0 %llx, using %s\n",
+            cpu_has(X86_FEATURE_OSXSAVE) ? "enabled" : "not supported",
+            xcr0, simd_level == FPU_SIMD_AVX2 ? "AVX2" : "SSE2");
+}
+
+fpu_simd_t fpu_simd_level(void)
+{
+    return simd_level;
+}
+
+void kernel_fpu_begin(void)
+{
+    uint64_t flags;
+
+    __asm__ volatile("pushfq\n\t"
+                     "popq %0\n\t"
+                     "cli"
+                     : "=r"(flags)
+                     :
+                     : "memory");
+
+    if (fpu_depth++ == 0)
+        fpu_saved_flags = flags;
+}
+
+void kernel_fpu_end(void)
+{
+    if (fpu_depth == 0)
+    {
+        kprintf("kernel_fpu_end: ERROR - not in an FPU region\n");
+        return;
+    }
+
+    if (--fpu_depth == 0 && (fpu_saved_flags & RFLAGS_IF))
+        __asm__ volatile("sti" ::: "memory");
+}
@@ -0,0 +1,230 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * log.c - Kernel log ring (dmesg).
+ * Responsibilities:
+ *  - reserve, fill and commit records without locks (log_store)
+ *  - read records back by sequence number, detecting overwrites (log_read)
+ *  - drain new records to the console sinks, dump the whole ring
+ * Notes:
+ *  - a writer takes a block of sequence numbers with one fetch-and-add;
+ *    sequence s lives in slot s % LOG_RECORDS
+ *  - the seq word of a slot works like a seqlock: the writer stores
+ *    s | LOG_BUSY, fills the slot, then stores s with release order. A
+ *    reader copies the slot only if seq == s before and after the copy.
+ *  - a reader stops at the first record that is reserved but not yet
+ *    committed, so the console keeps the order the sequence numbers give
+ *  - sequence numbers start at 1, so a zeroed slot never looks committed
+ *  - one drain runs at a time; a flush that finds one running leaves its
+ *    record to it through console_pending, which the drain checks after it
+ *    lets go of console_busy
+ *  - the sink list only grows; a sink is linked in after it is set up, so
+ *    a drain walking the list never sees a half-initialized entry
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/log.h>
+#include <lib/print.h>
+#include <lib/string.h>
+#include <lib/tsc.h>
+
+#define LOG_BUSY (1ULL << 63)
+
+static log_record_t log_ring[LOG_RECORDS];
+static uint64_t log_seq = 1;     // next sequence number to hand out
+static console_sink_t *sinks = NULL;
+static int console_busy = 0;
+static int console_pending = 0; // set by every flush, cleared by the drain that serves it
+
+int log_console_level = LOG_INFO;
+
+static inline log_record_t *slot_of(uint64_t seq)
+{
+    return &log_ring[seq & (LOG_RECORDS - 1)];
+}
+
+uint64_t log_store(int level, const char *text, size_t len)
+{
+    return log_store_flags(level, 0, text, len);
+}
+
+uint64_t log_store_flags(int level, uint8_t flags, const char *text, size_t len)
+{
+    uint64_t tsc = rdtsc();
+    uint64_t count = len ? (len + LOG_TEXT_MAX - 1) / LOG_TEXT_MAX : 1;
+
+    // one block, so the pieces of a long message stay adjacent
+    uint64_t first = __atomic_fetch_add(&log_seq, count, __ATOMIC_RELAXED);
+
+    for (uint64_t s = first; s < first + count; s++)
+    {
+        log_record_t *r = slot_of(s);
+        size_t n = len > LOG_TEXT_MAX ? LOG_TEXT_MAX : len;
+
+        __atomic_store_n(&r->seq, s | LOG_BUSY, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        r->tsc = tsc;
+        r->len = (uint16_t)n;
+        r->level = (uint8_t)level;
+        r->flags = s == first ? flags : LOG_CONT;
+        memcpy(r->text, text, n);
+
+        __atomic_store_n(&r->seq, s, __ATOMIC_RELEASE);
+
+        text += n;
+        len -= n;
+    }
+
+    return first;
+}
+
+int log_read(uint64_t *seq, log_record_t *rec)
+{
+    for (;;)
+    {
+        uint64_t head = __atomic_load_n(&log_seq, __ATOMIC_ACQUIRE);
+        uint64_t s = *seq;
+
+        // everything older than one ring has been overwritten
+        if (head > LOG_RECORDS && s < head - LOG_RECORDS)
+            s = head - LOG_RECORDS;
+        if (s == 0)
+            s = 1;
+        if (s >= head)
+            return 0;
+
+        log_record_t *r = slot_of(s);
+        uint64_t v = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+        if ((v & ~LOG_BUSY) > s) // overwritten by a later lap
+        {
+            *seq = s + 1;
+            continue;
+        }
+        if (v != s) // reserved, not committed yet
+            return 0;
+
+        memcpy(rec, r, sizeof(*rec));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        *seq = s + 1;
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == s)
+            return 1;
+        // overwritten while copying, try the next one
+    }
+}
+
+uint64_t log_next_seq(void)
+{
+    return __atomic_load_n(&log_seq, __ATOMIC_ACQUIRE);
+}
+
+/* Write a NUL-terminated string to a sink without logging it */
+static void sink_note(console_sink_t *sink, const char *s)
+{
+    sink->write(s, strlen(s));
+}
+
+void log_register_sink(console_sink_t *sink)
+{
+    console_sink_t **link = &sinks;
+
+    // start at the oldest record still in the ring
+    uint64_t head = log_next_seq();
+    sink->seq = head > LOG_RECORDS ? head - LOG_RECORDS : 1;
+    sink->next = NULL;
+
+    while (*link)
+        link = &(*link)->next;
+    __atomic_store_n(link, sink, __ATOMIC_RELEASE);
+
+    log_console_flush();
+}
+
+/* Write the records sink has not seen */
+static void drain_sink(console_sink_t *sink)
+{
+    log_record_t rec;
+    uint64_t expect = sink->seq;
+
+    while (log_read(&sink->seq, &rec))
+    {
+        if (rec.seq != expect)
+        {
+            char num[32];
+            utoa(rec.seq - expect, num, 10);
+            sink_note(sink, "[log: ");
+            sink_note(sink, num);
+            sink_note(sink, " records lost]\n");
+        }
+        expect = rec.seq + 1;
+
+        if (rec.level <= log_console_level)
+            sink->write(rec.text, rec.len);
+    }
+
+    if (sink->flush)
+        sink->flush();
+}
+
+void log_console_flush(void)
+{
+    // before trying console_busy, so a drain running now sees it when it ends
+    __atomic_store_n(&console_pending, 1, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&console_pending, __ATOMIC_SEQ_CST))
+    {
+        // a nested caller leaves its record to the drain already running
+        if (__atomic_exchange_n(&console_busy, 1, __ATOMIC_ACQUIRE))
+            return;
+
+        // every record committed before this point is drained below
+        __atomic_store_n(&console_pending, 0, __ATOMIC_SEQ_CST);
+
+        for (console_sink_t *sink = __atomic_load_n(&sinks, __ATOMIC_ACQUIRE); sink;
+             sink = __atomic_load_n(&sink->next, __ATOMIC_ACQUIRE))
+            drain_sink(sink);
+
+        __atomic_store_n(&console_busy, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Write text to every sink */
+static void sinks_write(const char *text, size_t len)
+{
+    for (console_sink_t *sink = __atomic_load_n(&sinks, __ATOMIC_ACQUIRE); sink;
+         sink = __atomic_load_n(&sink->next, __ATOMIC_ACQUIRE))
+        sink->write(text, len);
+}
+
+void log_dump(void)
+{
+    log_record_t rec;
+    uint64_t seq = 0;
+    uint64_t end = log_next_seq();
+    char num[32];
+
+    while (seq < end && log_read(&seq, &rec))
+    {
+        // "[tsc] <level> " before the first piece of each message
+        if (!(rec.flags & LOG_CONT))
+        {
+            sinks_write("[", 1);
+            utoa(rec.tsc, num, 10);
+            sinks_write(num, strlen(num));
+            sinks_write("] <", 3);
+            utoa(rec.level, num, 10);
+            sinks_write(num, strlen(num));
+            sinks_write("> ", 2);
+        }
+        sinks_write(rec.text, rec.len);
+    }
+
+    for (console_sink_t *sink = __atomic_load_n(&sinks, __ATOMIC_ACQUIRE); sink;
+         sink = __atomic_load_n(&sink->next, __ATOMIC_ACQUIRE))
+    {
+        if (sink->flush)
+            sink->flush();
+    }
+}
@@ -11,6 +11,7 @@
  */
 
 #include <lib/print.h>
+#include <lib/init.h>
 #include <lib/logo.h>
 
 /* The URIX logo in ascii characters. */
@@ -22,7 +23,7 @@ static const char *urix_logo[] = {
     "    |_______|   \\____/  |_| \\_\\|___|/_/ \\_\\",
 };
 
-void print_logo(void)
+void __init print_logo(void)
 {
     size_t lines = sizeof(urix_logo) / sizeof(urix_logo[0]);
     set_color(VGA_COLOR_CYAN, VGA_COLOR_BLACK);
@@ -2,13 +2,21 @@
  * Licensed under MIT License - URIX project.
  * print.c - Higher-level console printing utilities.
  * Responsibilities:
- *  - provide kprintf (printf-style formatted output)
+ *  - provide kprintf / klog (printf-style formatted output)
+ *  - send formatted messages through the log ring (lib/log.h)
  *  - wrap low-level VGA/console calls
+ *  - format printf-style into any sink (kvformat), or a buffer (kvsnprintf)
  *  - support integers (signed/unsigned), hex, binary, strings
  *  - manage text color and screen clearing
  * Notes:
- *  - implements kvsnprintf as a minimal formatting engine
- *  - handles 32-bit, long, and long long specifiers
+ *  - the formatter writes straight to the sink: literal text in runs,
+ *    numbers from a small stack buffer filled back to front (two decimal
+ *    digits per division, hex / octal / binary by shifting)
+ *  - flags - 0 + space #, width and precision (both also as *), length
+ *    hh h l ll z j t, conversions d i u x X o b c s p %
+ *  - kernel convention: %lx / %llx (and %p) always print a 0x prefix, %x
+ *    only with #
+ *  - an unknown conversion is printed as written
  */
 
 
@@ -17,167 +25,504 @@
 #include <stddef.h>
 #include <lib/print.h>
 #include <lib/string.h>
+#include <lib/log.h>
 
 // track whether a default color has been set
 static int color_initialized = 0;
 
+// conversion flags
+#define FMT_LEFT 0x01  // '-'
+#define FMT_ZERO 0x02  // '0'
+#define FMT_PLUS 0x04  // '+'
+#define FMT_SPACE 0x08 // ' '
+#define FMT_ALT 0x10   // '#'
+
+// length modifiers
+enum
+{
+    LEN_INT,
+    LEN_CHAR,  // hh
+    LEN_SHORT, // h
+    LEN_LONG,  // l, t
+    LEN_LLONG, // ll, j
+    LEN_SIZE,  // z
+};
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char digits_lower[] = "0123456789abcdef";
+static const char digits_upper[] = "0123456789ABCDEF";
+
+/* kprintf's sink: stores the message in the log ring in buf-sized pieces,
+ * all but the first marked LOG_CONT; buf holds whole records
+ */
+typedef struct
+{
+    char buf[LOG_TEXT_MAX * 5];
+    size_t used;
+    int level;
+    uint8_t flags;
+} klog_buf_t;
+
+/* kvsnprintf's sink */
+typedef struct
+{
+    char *buf;
+    size_t size;
+    size_t used;
+} kbuf_t;
+
 /**
- * kprintf - printf-style console output
+ * format_dec - write v in decimal so that it ends at end, return its start
  */
-void kprintf(const char *fmt, ...)
+static char *format_dec(char *end, uint64_t v)
 {
-    va_list args;
-    va_start(args, fmt);
+    while (v >= 100)
+    {
+        unsigned r = (unsigned)(v % 100) * 2;
+        v /= 100;
+        end -= 2;
+        end[0] = digit_pairs[r];
+        end[1] = digit_pairs[r + 1];
+    }
+
+    if (v >= 10)
+    {
+        end -= 2;
+        end[0] = digit_pairs[v * 2];
+        end[1] = digit_pairs[v * 2 + 1];
+    }
+    else
+    {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
 
-    char buf[512]; // temp buffer
+/**
+ * format_pow2 - write v in base 1 << shift so that it ends at end
+ */
+static char *format_pow2(char *end, uint64_t v, unsigned shift, const char *digits)
+{
+    uint64_t mask = (1U << shift) - 1;
 
-    if (!color_initialized)
+    do
     {
-        set_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK);
-        color_initialized = 1;
+        *--end = digits[v & mask];
+        v >>= shift;
+    } while (v);
+    return end;
+}
+
+/**
+ * emit_fill - write n copies of c (' ' or '0')
+ */
+static void emit_fill(kformat_sink_t sink, void *ctx, char c, size_t n)
+{
+    static const char spaces[] = "                ";
+    static const char zeros[] = "0000000000000000";
+    const char *src = c == '0' ? zeros : spaces;
+
+    while (n)
+    {
+        size_t k = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        sink(ctx, src, k);
+        n -= k;
     }
+}
 
-    kvsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
+/**
+ * emit_field - write prefix, zeros and body padded to width; returns the
+ * bytes written
+ */
+static size_t emit_field(kformat_sink_t sink, void *ctx, unsigned flags, size_t width,
+                         const char *prefix, size_t plen, size_t zeros,
+                         const char *body, size_t blen)
+{
+    size_t len = plen + zeros + blen;
+    size_t pad = width > len ? width - len : 0;
+
+    if (pad && !(flags & FMT_LEFT))
+        emit_fill(sink, ctx, ' ', pad);
+    if (plen)
+        sink(ctx, prefix, plen);
+    if (zeros)
+        emit_fill(sink, ctx, '0', zeros);
+    if (blen)
+        sink(ctx, body, blen);
+    if (pad && (flags & FMT_LEFT))
+        emit_fill(sink, ctx, ' ', pad);
 
-    console_writestring(buf);
+    return len + pad;
 }
 
 /**
- * kvsnprintf - printf core (minimal subset)
+ * kvformat - printf core, output goes to sink
  */
-void kvsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+int kvformat(kformat_sink_t sink, void *ctx, const char *fmt, va_list args)
 {
-    size_t i = 0;
+    size_t total = 0;
 
-    for (; *fmt && i < size - 1; fmt++)
+    while (*fmt)
     {
-        if (*fmt == '%')
+        // literal run up to the next '%'
+        const char *lit = fmt;
+        while (*fmt && *fmt != '%')
+            fmt++;
+        if (fmt != lit)
         {
-            fmt++; // skip '%'
+            sink(ctx, lit, (size_t)(fmt - lit));
+            total += (size_t)(fmt - lit);
+        }
+        if (!*fmt)
+            break;
+
+        const char *spec = fmt++; // the '%'
+        unsigned flags = 0;
+        size_t width = 0;
+        long prec = -1;
+        int len = LEN_INT;
+
+        for (;; fmt++)
+        {
+            if (*fmt == '-')
+                flags |= FMT_LEFT;
+            else if (*fmt == '0')
+                flags |= FMT_ZERO;
+            else if (*fmt == '+')
+                flags |= FMT_PLUS;
+            else if (*fmt == ' ')
+                flags |= FMT_SPACE;
+            else if (*fmt == '#')
+                flags |= FMT_ALT;
+            else
+                break;
+        }
+
+        if (*fmt == '*')
+        {
+            int w = va_arg(args, int);
+            if (w < 0)
+            {
+                flags |= FMT_LEFT;
+                w = -w;
+            }
+            width = (size_t)w;
+            fmt++;
+        }
+        else
+        {
+            while (*fmt >= '0' && *fmt <= '9')
+                width = width * 10 + (size_t)(*fmt++ - '0');
+        }
 
-            if (*fmt == 'd') // signed decimal
+        if (*fmt == '.')
+        {
+            fmt++;
+            if (*fmt == '*')
             {
-                int value = va_arg(args, int);
-                char tmp[32];
-                itoa(value, tmp, 10);
-                for (char *p = tmp; *p && i < size - 1; p++)
-                    buf[i++] = *p;
+                int p = va_arg(args, int);
+                prec = p < 0 ? -1 : p;
+                fmt++;
             }
-            else if (*fmt == 'u') // unsigned decimal
+            else
             {
-                unsigned int value = va_arg(args, unsigned int);
-                char tmp[32];
-                utoa(value, tmp, 10);
-                for (char *p = tmp; *p && i < size - 1; p++)
-                    buf[i++] = *p;
+                prec = 0;
+                while (*fmt >= '0' && *fmt <= '9')
+                    prec = prec * 10 + (*fmt++ - '0');
             }
-            else if (*fmt == 's') // string
+        }
+
+        if (*fmt == 'h')
+        {
+            fmt++;
+            len = LEN_SHORT;
+            if (*fmt == 'h')
             {
-                char *str = va_arg(args, char *);
-                if (!str)
-                    str = "(null)";
-                while (*str && i < size - 1)
-                    buf[i++] = *str++;
+                fmt++;
+                len = LEN_CHAR;
             }
-            else if (*fmt == 'x' || *fmt == 'X') // hex
+        }
+        else if (*fmt == 'l')
+        {
+            fmt++;
+            len = LEN_LONG;
+            if (*fmt == 'l')
             {
-                unsigned int value = va_arg(args, unsigned int);
-                char tmp[32];
-                utoa(value, tmp, 16);
-                for (char *p = tmp; *p && i < size - 1; p++)
-                    buf[i++] = *p;
+                fmt++;
+                len = LEN_LLONG;
             }
-            else if (*fmt == 'b') // binary
+        }
+        else if (*fmt == 'z')
+        {
+            fmt++;
+            len = LEN_SIZE;
+        }
+        else if (*fmt == 'j')
+        {
+            fmt++;
+            len = LEN_LLONG;
+        }
+        else if (*fmt == 't')
+        {
+            fmt++;
+            len = LEN_LONG;
+        }
+
+        char conv = *fmt;
+        if (!conv) // '%' at the end: print the rest as written
+        {
+            sink(ctx, spec, (size_t)(fmt - spec));
+            total += (size_t)(fmt - spec);
+            break;
+        }
+        fmt++;
+
+        if (conv == '%')
+        {
+            sink(ctx, "%", 1);
+            total++;
+            continue;
+        }
+
+        if (conv == 'c')
+        {
+            char c = (char)va_arg(args, int);
+            total += emit_field(sink, ctx, flags, width, NULL, 0, 0, &c, 1);
+            continue;
+        }
+
+        if (conv == 's')
+        {
+            const char *str = va_arg(args, const char *);
+            if (!str)
+                str = "(null)";
+            size_t n = prec >= 0 ? strnlen(str, (size_t)prec) : strlen(str);
+            total += emit_field(sink, ctx, flags, width, NULL, 0, 0, str, n);
+            continue;
+        }
+
+        // integers
+        uint64_t v;
+        int negative = 0;
+        unsigned shift = 0; // 0: decimal
+        const char *digits = digits_lower;
+        int hex_prefix = 0;
+
+        if (conv == 'd' || conv == 'i')
+        {
+            int64_t sv;
+            if (len == LEN_CHAR)
+                sv = (signed char)va_arg(args, int);
+            else if (len == LEN_SHORT)
+                sv = (short)va_arg(args, int);
+            else if (len == LEN_LONG || len == LEN_SIZE)
+                sv = va_arg(args, long);
+            else if (len == LEN_LLONG)
+                sv = va_arg(args, long long);
+            else
+                sv = va_arg(args, int);
+
+            negative = sv < 0;
+            v = negative ? 0 - (uint64_t)sv : (uint64_t)sv;
+        }
+        else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o' || conv == 'b')
+        {
+            if (len == LEN_CHAR)
+                v = (unsigned char)va_arg(args, unsigned int);
+            else if (len == LEN_SHORT)
+                v = (unsigned short)va_arg(args, unsigned int);
+            else if (len == LEN_LONG)
+                v = va_arg(args, unsigned long);
+            else if (len == LEN_LLONG)
+                v = va_arg(args, unsigned long long);
+            else if (len == LEN_SIZE)
+                v = va_arg(args, size_t);
+            else
+                v = va_arg(args, unsigned int);
+
+            if (conv == 'x' || conv == 'X')
             {
-                unsigned int value = va_arg(args, unsigned int);
-                char tmp[64];
-                utoa(value, tmp, 2);
-                for (char *p = tmp; *p && i < size - 1; p++)
-                    buf[i++] = *p;
+                shift = 4;
+                digits = conv == 'X' ? digits_upper : digits_lower;
+                hex_prefix = (flags & FMT_ALT) ? v != 0 : (len == LEN_LONG || len == LEN_LLONG);
             }
-            else if (*fmt == 'l') // check for 'l' or 'll'
+            else if (conv == 'o')
             {
-                if (*(fmt + 1) == 'l') // "ll" case
-                {
-                    fmt += 2; // skip both 'l's
-                    uint64_t value = va_arg(args, uint64_t);
-                    char tmp[64];
-
-                    if (*fmt == 'u') // %llu
-                    {
-                        utoa(value, tmp, 10);
-                    }
-                    else if (*fmt == 'x' || *fmt == 'X') // %llx / %llX
-                    {
-                        utoa(value, tmp, 16);
-                        buf[i++] = '0';
-                        buf[i++] = 'x';
-                    }
-                    else if (*fmt == 'd') // %lld (signed)
-                    {
-                        itoa((int64_t)value, tmp, 10);
-                    }
-                    else
-                    {
-                        // unknown specifier, print literally
-                        buf[i++] = '%';
-                        buf[i++] = 'l';
-                        buf[i++] = 'l';
-                        buf[i++] = *fmt;
-                        continue;
-                    }
-
-                    for (char *p = tmp; *p && i < size - 1; p++)
-                        buf[i++] = *p;
-                }
-                else
-                {
-                    // single 'l' (e.g., %ld, %lu, %lx)
-                    fmt++;
-                    unsigned long value = va_arg(args, unsigned long);
-                    char tmp[64];
-
-                    if (*fmt == 'u')
-                    {
-                        utoa(value, tmp, 10);
-                    }
-                    else if (*fmt == 'x' || *fmt == 'X')
-                    {
-                        utoa(value, tmp, 16);
-                        buf[i++] = '0';
-                        buf[i++] = 'x';
-                    }
-                    else if (*fmt == 'd')
-                    {
-                        itoa((long)value, tmp, 10);
-                    }
-                    else
-                    {
-                        buf[i++] = '%';
-                        buf[i++] = 'l';
-                        buf[i++] = *fmt;
-                        continue;
-                    }
-                    
-                    for (char *p = tmp; *p && i < size - 1; p++)
-                        buf[i++] = *p;
-                }
+                shift = 3;
             }
-
-            else // unknown specifier → print literally
+            else if (conv == 'b')
             {
-                buf[i++] = '%';
-                buf[i++] = *fmt;
+                shift = 1;
             }
         }
-        else
+        else if (conv == 'p')
+        {
+            v = (uintptr_t)va_arg(args, void *);
+            shift = 4;
+            hex_prefix = 1;
+        }
+        else // unknown conversion: print as written
+        {
+            sink(ctx, spec, (size_t)(fmt - spec));
+            total += (size_t)(fmt - spec);
+            continue;
+        }
+
+        char tmp[64]; // 64 binary digits at most
+        char *end = tmp + sizeof(tmp);
+        char *body = end;
+
+        if (v || prec != 0)
+            body = shift ? format_pow2(end, v, shift, digits) : format_dec(end, v);
+        size_t blen = (size_t)(end - body);
+
+        char prefix[2];
+        size_t plen = 0;
+        if (negative)
+            prefix[plen++] = '-';
+        else if ((conv == 'd' || conv == 'i') && (flags & FMT_PLUS))
+            prefix[plen++] = '+';
+        else if ((conv == 'd' || conv == 'i') && (flags & FMT_SPACE))
+            prefix[plen++] = ' ';
+        else if (hex_prefix)
+        {
+            prefix[plen++] = '0';
+            prefix[plen++] = conv == 'X' ? 'X' : 'x';
+        }
+
+        size_t zeros = prec > (long)blen ? (size_t)prec - blen : 0;
+        if (conv == 'o' && (flags & FMT_ALT) && !zeros && (blen == 0 || body[0] != '0'))
+            zeros = 1;
+        if ((flags & FMT_ZERO) && !(flags & FMT_LEFT) && prec < 0 && width > plen + blen)
+            zeros = width - plen - blen;
+
+        total += emit_field(sink, ctx, flags, width, prefix, plen, zeros, body, blen);
+    }
+
+    return (int)total;
+}
+
+/**
+ * klog_sink - collect output, store every full buffer in the log ring
+ */
+static void klog_sink(void *ctx, const char *s, size_t n)
+{
+    klog_buf_t *b = ctx;
+
+    while (n)
+    {
+        size_t k = sizeof(b->buf) - b->used;
+        if (k > n)
+            k = n;
+
+        memcpy(b->buf + b->used, s, k);
+        b->used += k;
+        s += k;
+        n -= k;
+
+        if (b->used == sizeof(b->buf))
         {
-            buf[i++] = *fmt;
+            log_store_flags(b->level, b->flags, b->buf, b->used);
+            b->used = 0;
+            b->flags = LOG_CONT;
         }
     }
+}
+
+/**
+ * vklog - format, store in the log ring, drain the ring to the console
+ */
+static void vklog(int level, const char *fmt, va_list args)
+{
+    klog_buf_t b;
+
+    if (!color_initialized)
+    {
+        set_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK);
+        color_initialized = 1;
+    }
 
-    buf[i] = '\0';
+    b.used = 0;
+    b.level = level;
+    b.flags = 0;
+    kvformat(klog_sink, &b, fmt, args);
+    if (b.used)
+        log_store_flags(level, b.flags, b.buf, b.used);
+
+    log_console_flush();
+}
+
+/**
+ * kprintf - printf-style console output (LOG_INFO)
+ */
+void kprintf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vklog(LOG_INFO, fmt, args);
+    va_end(args);
+}
+
+/**
+ * klog - printf-style output at a log level
+ */
+void klog(int level, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vklog(level, fmt, args);
+    va_end(args);
+}
+
+/**
+ * kbuf_sink - copy into the buffer, dropping what does not fit
+ */
+static void kbuf_sink(void *ctx, const char *s, size_t n)
+{
+    kbuf_t *b = ctx;
+
+    if (b->used + 1 < b->size)
+    {
+        size_t room = b->size - 1 - b->used;
+        memcpy(b->buf + b->used, s, n < room ? n : room);
+    }
+    b->used += n;
+}
+
+/**
+ * kvsnprintf - format into buf, always terminated (if size > 0)
+ */
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+    kbuf_t b = {buf, size, 0};
+    int n = kvformat(kbuf_sink, &b, fmt, args);
+
+    if (size)
+        buf[b.used < size ? b.used : size - 1] = '\0';
+    return n;
+}
+
+/**
+ * ksnprintf - kvsnprintf with variable arguments
+ */
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return n;
 }
 
 /**
@@ -2,29 +2,258 @@
  * Licensed under MIT License - URIX project.
  * string.c - minimal string and number conversion utilities.
  * Responsibilities:
- *  - provide strlen() implementation
+ *  - provide strlen / strnlen / memchr, vectorized (SSE2 / AVX2) past the
+ *    first MEM_SIMD_MIN bytes
  *  - implement integer/string conversions (itoa, utoa)
  *  - reverse strings in-place (helper for conversions)
+ *  - provide memset / memcpy / memmove / memcmp and streaming-store variants
  * Notes:
  *  - only implements minimal subset needed by kernel
  *  - integer conversions support bases 2–36
  *  - designed for use in printf-style functions
+ *  - mem* use overlapping 8-byte accesses below 16 bytes, 8-byte loops up
+ *    to MEM_REP_MIN, then rep stosb / movsb when the CPU has ERMS or FSRM
+ *    (rep stosq / movsq otherwise)
+ *  - memset / memcpy are alternatives jump sites: each CPU flavour is its
+ *    own body and alternatives_apply points the site at the right one
+ *  - vector code lives in target("sse2") / target("avx2") helpers that only
+ *    run between kernel_fpu_begin / kernel_fpu_end; shorter inputs stay on
+ *    8-byte scalar paths so they never pay for the region
+ *  - vector scans use aligned loads, which cannot cross into an unmapped
+ *    page, so reading past the terminator / end is safe
+ *  - the compiler emits calls to memset / memcpy / memmove / memcmp on its
+ *    own, so they must never call back into themselves: loop-to-libcall
+ *    conversion is disabled for this file
  */
 
 #include <stdint.h>
 #include <stddef.h>
 #include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpu_features.h>
+#include <lib/alternatives.h>
+#include <lib/fpu.h>
+#include <lib/string.h>
 #include <memory/physical/pmm.h>
 
+#pragma GCC optimize("no-tree-loop-distribute-patterns")
+
+/* Unaligned, alias-safe 8 / 4-byte accesses */
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_ua;
+typedef uint32_t __attribute__((may_alias, aligned(1))) u32_ua;
+
+/* 16 / 32-byte vectors (aligned, and unaligned for memcmp) */
+typedef char v16qi __attribute__((vector_size(16)));
+typedef char v32qi __attribute__((vector_size(32)));
+typedef char v16qi_ua __attribute__((vector_size(16), aligned(1)));
+typedef char v32qi_ua __attribute__((vector_size(32), aligned(1)));
+
+#define SSE2 __attribute__((target("sse2"), noinline))
+#define AVX2 __attribute__((target("avx2"), noinline))
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+/* Vector width used by the str* / memchr / memcmp kernels (set by string_init) */
+static fpu_simd_t simd = FPU_SIMD_NONE;
+
+/* Nonzero iff word x has a zero byte; the lowest set bit marks the first one */
+static inline uint64_t zero_bytes(uint64_t x)
+{
+    return (x - ONES) & ~x & HIGHS;
+}
+
+/* Length of the string at s, which is 16-byte aligned down inside a mapped page */
+static SSE2 size_t strlen_sse2(const char *s)
+{
+    uintptr_t off = (uintptr_t)s & 15;
+    const v16qi *p = (const v16qi *)(s - off);
+    const v16qi zero = {0};
+    uint32_t m = (uint32_t)__builtin_ia32_pmovmskb128(*p == zero) >> off;
+
+    if (m)
+        return (size_t)__builtin_ctz(m);
+
+    for (;;)
+    {
+        p++;
+        m = (uint32_t)__builtin_ia32_pmovmskb128(*p == zero);
+        if (m)
+            return (size_t)((const char *)p - s) + (size_t)__builtin_ctz(m);
+    }
+}
+
+static AVX2 size_t strlen_avx2(const char *s)
+{
+    uintptr_t off = (uintptr_t)s & 31;
+    const v32qi *p = (const v32qi *)(s - off);
+    const v32qi zero = {0};
+    uint32_t m = (uint32_t)__builtin_ia32_pmovmskb256(*p == zero) >> off;
+
+    if (m)
+        return (size_t)__builtin_ctz(m);
+
+    for (;;)
+    {
+        p++;
+        m = (uint32_t)__builtin_ia32_pmovmskb256(*p == zero);
+        if (m)
+            return (size_t)((const char *)p - s) + (size_t)__builtin_ctz(m);
+    }
+}
+
+/* Index of the first byte equal to c in [s, s + n), or n */
+static SSE2 size_t find_byte_sse2(const unsigned char *s, unsigned char c, size_t n)
+{
+    uintptr_t off = (uintptr_t)s & 15;
+    const v16qi *p = (const v16qi *)(s - off);
+    const v16qi cv = (v16qi){0} + (char)c;
+    size_t end = n + off; /* bytes from p to s + n */
+    uint32_t m = (uint32_t)__builtin_ia32_pmovmskb128(*p == cv) & (0xFFFFU << off);
+
+    for (size_t pos = 0;;)
+    {
+        if (m)
+        {
+            size_t i = pos + (size_t)__builtin_ctz(m);
+            return i < end ? i - off : n;
+        }
+
+        pos += 16;
+        if (pos >= end)
+            return n;
+        m = (uint32_t)__builtin_ia32_pmovmskb128(*++p == cv);
+    }
+}
+
+static AVX2 size_t find_byte_avx2(const unsigned char *s, unsigned char c, size_t n)
+{
+    uintptr_t off = (uintptr_t)s & 31;
+    const v32qi *p = (const v32qi *)(s - off);
+    const v32qi cv = (v32qi){0} + (char)c;
+    size_t end = n + off;
+    uint32_t m = (uint32_t)__builtin_ia32_pmovmskb256(*p == cv) & (0xFFFFFFFFU << off);
+
+    for (size_t pos = 0;;)
+    {
+        if (m)
+        {
+            size_t i = pos + (size_t)__builtin_ctz(m);
+            return i < end ? i - off : n;
+        }
+
+        pos += 32;
+        if (pos >= end)
+            return n;
+        m = (uint32_t)__builtin_ia32_pmovmskb256(*++p == cv);
+    }
+}
+
+/* memcmp for n >= 16: unaligned blocks, the last one overlapping its predecessor */
+static SSE2 int memcmp_sse2(const unsigned char *x, const unsigned char *y, size_t n)
+{
+    for (size_t i = 0;; i += 16)
+    {
+        if (i + 16 > n)
+            i = n - 16;
+
+        uint32_t eq = (uint32_t)__builtin_ia32_pmovmskb128(*(const v16qi_ua *)(x + i) ==
+                                                           *(const v16qi_ua *)(y + i));
+        if (eq != 0xFFFFU)
+        {
+            size_t k = i + (size_t)__builtin_ctz(~eq);
+            return x[k] < y[k] ? -1 : 1;
+        }
+
+        if (i + 16 == n)
+            return 0;
+    }
+}
+
+static AVX2 int memcmp_avx2(const unsigned char *x, const unsigned char *y, size_t n)
+{
+    for (size_t i = 0;; i += 32)
+    {
+        if (i + 32 > n)
+            i = n - 32;
+
+        uint32_t eq = (uint32_t)__builtin_ia32_pmovmskb256(*(const v32qi_ua *)(x + i) ==
+                                                           *(const v32qi_ua *)(y + i));
+        if (eq != 0xFFFFFFFFU)
+        {
+            size_t k = i + (size_t)__builtin_ctz(~eq);
+            return x[k] < y[k] ? -1 : 1;
+        }
+
+        if (i + 32 == n)
+            return 0;
+    }
+}
+
+/* Index of the first byte equal to c in [s, s + n), or n; vector past MEM_SIMD_MIN */
+static size_t find_byte(const unsigned char *s, unsigned char c, size_t n)
+{
+    if (n >= MEM_SIMD_MIN && simd != FPU_SIMD_NONE)
+    {
+        /* Keep s + n + 32 from wrapping; no object is that large anyway */
+        if (n > (size_t)-1 - 64)
+            n = (size_t)-1 - 64;
+
+        kernel_fpu_begin();
+        size_t i = simd == FPU_SIMD_AVX2 ? find_byte_avx2(s, c, n) : find_byte_sse2(s, c, n);
+        kernel_fpu_end();
+        return i;
+    }
+
+    size_t i = 0;
+    while (i < n && s[i] != c)
+        i++;
+    return i;
+}
+
 /**
  * strlen - return length of null-terminated string
  */
 size_t strlen(const char *str)
 {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+    const char *p = str;
+
+    for (; (uintptr_t)p & 7; p++)
+    {
+        if (!*p)
+            return (size_t)(p - str);
+    }
+
+    /* Aligned words never cross a page, so reading past the terminator is safe */
+    const u64_ua *w = (const u64_ua *)p;
+    for (unsigned i = 0; simd == FPU_SIMD_NONE || i < MEM_SIMD_MIN / 8; i++, w++)
+    {
+        uint64_t z = zero_bytes(*w);
+        if (z)
+            return (size_t)((const char *)w - str) + (size_t)__builtin_ctzll(z) / 8;
+    }
+
+    kernel_fpu_begin();
+    size_t len = simd == FPU_SIMD_AVX2 ? strlen_avx2((const char *)w) : strlen_sse2((const char *)w);
+    kernel_fpu_end();
+    return (size_t)((const char *)w - str) + len;
+}
+
+/*
+ * returns strlen(str), but looks at no more than maxlen bytes.
+ */
+size_t strnlen(const char *str, size_t maxlen)
+{
+    return find_byte((const unsigned char *)str, 0, maxlen);
+}
+
+/*
+ * returns a pointer to the first byte equal to (unsigned char)c in [s, s + n), or NULL.
+ */
+void *memchr(const void *s, int c, size_t n)
+{
+    size_t i = find_byte((const unsigned char *)s, (unsigned char)c, n);
+    return i < n ? (void *)((const unsigned char *)s + i) : NULL;
 }
 
 /**
@@ -117,22 +346,324 @@ char *utoa(uint64_t num, char *buffer, int base)
 }
 
 /*
- * takes a destination pointer, value, and size to iterate on.
- * enters the value given into the given count of bytes in memory, starting at the dest pointer given.
+ * takes the SIMD level from fpu_init, which must run first.
+ */
+void __init string_init(void)
+{
+    simd = fpu_simd_level();
+}
+
+static inline void rep_stosb(void *d, uint8_t c, size_t n)
+{
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+static inline void rep_stosq(void *d, uint64_t v, size_t n)
+{
+    __asm__ volatile("rep stosq" : "+D"(d), "+c"(n) : "a"(v) : "memory");
+}
+
+static inline void rep_movsb(void *d, const void *s, size_t n)
+{
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void rep_movsq(void *d, const void *s, size_t n)
+{
+    __asm__ volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void movnti(void *d, uint64_t v)
+{
+    __asm__ volatile("movnti %1, %0" : "=m"(*(uint64_t *)d) : "r"(v));
+}
+
+/*
+ * copies n < 16 bytes; every load happens before the first store, so the
+ * ranges may overlap.
+ */
+static inline void copy_small(unsigned char *d, const unsigned char *s, size_t n)
+{
+    if (n >= 8)
+    {
+        uint64_t head = *(const u64_ua *)s;
+        uint64_t tail = *(const u64_ua *)(s + n - 8);
+        *(u64_ua *)d = head;
+        *(u64_ua *)(d + n - 8) = tail;
+    }
+    else if (n >= 4)
+    {
+        uint32_t head = *(const u32_ua *)s;
+        uint32_t tail = *(const u32_ua *)(s + n - 4);
+        *(u32_ua *)d = head;
+        *(u32_ua *)(d + n - 4) = tail;
+    }
+    else if (n)
+    {
+        unsigned char first = s[0], mid = s[n / 2], last = s[n - 1];
+        d[0] = first;
+        d[n / 2] = mid;
+        d[n - 1] = last;
+    }
+}
+
+/*
+ * copies n bytes low to high, with rep movsb from rep_min bytes on. Safe for
+ * overlap when d <= s (the tail word is read before anything is written).
+ */
+static inline __attribute__((always_inline)) void
+copy_forward(unsigned char *d, const unsigned char *s, size_t n, size_t rep_min)
+{
+    if (n < 16)
+    {
+        copy_small(d, s, n);
+        return;
+    }
+
+    if (n >= rep_min)
+    {
+        rep_movsb(d, s, n);
+        return;
+    }
+
+    uint64_t tail = *(const u64_ua *)(s + n - 8);
+    size_t words = (n - 1) / 8;
+
+    if (n >= MEM_REP_MIN)
+    {
+        rep_movsq(d, s, words);
+    }
+    else
+    {
+        for (size_t i = 0; i < words; i++)
+            ((u64_ua *)d)[i] = ((const u64_ua *)s)[i];
+    }
+
+    *(u64_ua *)(d + n - 8) = tail;
+}
+
+/*
+ * memset with rep stosb from rep_min bytes on ((size_t)-1: never).
  */
-void *memset(void *s, int c, size_t n)
+static inline __attribute__((always_inline)) void *
+memset_body(void *dest, int value, uint64_t count, size_t rep_min)
 {
-    unsigned char *ptr = (unsigned char *)s;
-    unsigned char value = (unsigned char)c;
-    kprintf("memset(%llx, %x, %llu)\n", (uint64_t)s, c, n);
+    unsigned char *d = (unsigned char *)dest;
+    uint64_t v = 0x0101010101010101ULL * (uint8_t)value;
 
-    // Iterate through the memory block and set each byte
-    for (size_t i = 0; i < n; i++)
+    if (count < 16)
     {
-        //kprintf("Setting: %x\n", (unsigned int)ptr[i]);
+        if (count >= 8)
+        {
+            *(u64_ua *)d = v;
+            *(u64_ua *)(d + count - 8) = v;
+        }
+        else if (count >= 4)
+        {
+            *(u32_ua *)d = (uint32_t)v;
+            *(u32_ua *)(d + count - 4) = (uint32_t)v;
+        }
+        else if (count)
+        {
+            d[0] = (unsigned char)v;
+            d[count / 2] = (unsigned char)v;
+            d[count - 1] = (unsigned char)v;
+        }
+        return dest;
+    }
+
+    if (count >= rep_min)
+    {
+        rep_stosb(d, (uint8_t)value, count);
+        return dest;
+    }
 
-        ptr[i] = value;
+    size_t words = (count - 1) / 8;
+    if (count >= MEM_REP_MIN)
+    {
+        rep_stosq(d, v, words);
+    }
+    else
+    {
+        for (size_t i = 0; i < words; i++)
+            ((u64_ua *)d)[i] = v;
     }
 
-    return s; // Return the original pointer to the memory block
+    *(u64_ua *)(d + count - 8) = v;
+    return dest;
+}
+
+static __attribute__((used)) void *memset_generic(void *dest, int value, uint64_t count)
+{
+    return memset_body(dest, value, count, (size_t)-1);
+}
+
+static __attribute__((used)) void *memset_erms(void *dest, int value, uint64_t count)
+{
+    return memset_body(dest, value, count, MEM_REP_MIN);
+}
+
+static __attribute__((used)) void *memset_fsrm(void *dest, int value, uint64_t count)
+{
+    return memset_body(dest, value, count, MEM_REP_MIN_FSRM);
+}
+
+static __attribute__((used)) void *memcpy_generic(void *dest, const void *src, uint64_t count)
+{
+    copy_forward((unsigned char *)dest, (const unsigned char *)src, count, (size_t)-1);
+    return dest;
+}
+
+static __attribute__((used)) void *memcpy_erms(void *dest, const void *src, uint64_t count)
+{
+    copy_forward((unsigned char *)dest, (const unsigned char *)src, count, MEM_REP_MIN);
+    return dest;
+}
+
+static __attribute__((used)) void *memcpy_fsrm(void *dest, const void *src, uint64_t count)
+{
+    copy_forward((unsigned char *)dest, (const unsigned char *)src, count, MEM_REP_MIN_FSRM);
+    return dest;
+}
+
+/* memset / memcpy: best body first, the generic one until alternatives_apply */
+ALT_JUMP_SITE(memset, memset_generic);
+ALT_JUMP(memset, X86_FEATURE_FSRM, memset_fsrm);
+ALT_JUMP(memset, X86_FEATURE_ERMS, memset_erms);
+
+ALT_JUMP_SITE(memcpy, memcpy_generic);
+ALT_JUMP(memcpy, X86_FEATURE_FSRM, memcpy_fsrm);
+ALT_JUMP(memcpy, X86_FEATURE_ERMS, memcpy_erms);
+
+void *memmove(void *dest, const void *src, uint64_t count)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    /* d below s, or no overlap at all: a forward copy is safe */
+    if ((uintptr_t)d - (uintptr_t)s >= count)
+        return memcpy(dest, src, count);
+
+    if (count < 16)
+    {
+        copy_small(d, s, count);
+        return dest;
+    }
+
+    /* d overlaps the tail of s: copy high to low */
+    while (count >= 8)
+    {
+        count -= 8;
+        *(u64_ua *)(d + count) = *(const u64_ua *)(s + count);
+    }
+    while (count)
+    {
+        count--;
+        d[count] = s[count];
+    }
+
+    return dest;
+}
+
+int memcmp(const void *a, const void *b, uint64_t count)
+{
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    size_t i = 0;
+
+    if (count >= MEM_SIMD_MIN && simd != FPU_SIMD_NONE)
+    {
+        kernel_fpu_begin();
+        int r = simd == FPU_SIMD_AVX2 ? memcmp_avx2(x, y, count) : memcmp_sse2(x, y, count);
+        kernel_fpu_end();
+        return r;
+    }
+
+    for (; i + 8 <= count; i += 8)
+    {
+        uint64_t wx = *(const u64_ua *)(x + i);
+        uint64_t wy = *(const u64_ua *)(y + i);
+        if (wx != wy)
+        {
+            /* Big-endian order makes the first differing byte most significant */
+            return __builtin_bswap64(wx) < __builtin_bswap64(wy) ? -1 : 1;
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        if (x[i] != y[i])
+            return x[i] < y[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+void *memset_nt(void *dest, int value, uint64_t count)
+{
+    unsigned char *d = (unsigned char *)dest;
+    uint64_t v = 0x0101010101010101ULL * (uint8_t)value;
+
+    if (count < MEM_NT_MIN)
+        return memset(dest, value, count);
+
+    /* Cached head up to an 8-byte boundary, streaming body, cached tail */
+    size_t head = (8 - ((uintptr_t)d & 7)) & 7;
+    memset(d, value, head);
+    d += head;
+    count -= head;
+
+    for (; count >= 64; d += 64, count -= 64)
+    {
+        movnti(d, v);
+        movnti(d + 8, v);
+        movnti(d + 16, v);
+        movnti(d + 24, v);
+        movnti(d + 32, v);
+        movnti(d + 40, v);
+        movnti(d + 48, v);
+        movnti(d + 56, v);
+    }
+    for (; count >= 8; d += 8, count -= 8)
+        movnti(d, v);
+
+    /* Streaming stores are weakly ordered: make them visible before returning */
+    __asm__ volatile("sfence" ::: "memory");
+
+    memset(d, value, count);
+    return dest;
+}
+
+void *memcpy_nt(void *dest, const void *src, uint64_t count)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if (count < MEM_NT_MIN)
+        return memcpy(dest, src, count);
+
+    size_t head = (8 - ((uintptr_t)d & 7)) & 7;
+    copy_small(d, s, head);
+    d += head;
+    s += head;
+    count -= head;
+
+    for (; count >= 32; d += 32, s += 32, count -= 32)
+    {
+        uint64_t w0 = ((const u64_ua *)s)[0];
+        uint64_t w1 = ((const u64_ua *)s)[1];
+        uint64_t w2 = ((const u64_ua *)s)[2];
+        uint64_t w3 = ((const u64_ua *)s)[3];
+        movnti(d, w0);
+        movnti(d + 8, w1);
+        movnti(d + 16, w2);
+        movnti(d + 24, w3);
+    }
+    for (; count >= 8; d += 8, s += 8, count -= 8)
+        movnti(d, *(const u64_ua *)s);
+
+    __asm__ volatile("sfence" ::: "memory");
+
+    copy_small(d, s, count);
+    return dest;
 }
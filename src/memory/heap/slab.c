@@ -0,0 +1,519 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * slab.c - Slab allocator and kmalloc.
+ * Responsibilities:
+ *  - carve contiguous PMM frames into equal objects with a per-slab free list
+ *  - keep every cache's slabs on partial / full / empty lists
+ *  - serve kmalloc from 18 size classes, larger requests from whole frames
+ *  - count allocations, slabs and class rounding for kmem_print_stats
+ * Notes:
+ *  - the kmem_cache_t of every named cache comes from cache_cache, a slab
+ *    cache itself; the size classes and cache_cache are static
+ *  - allocation takes a partial slab first, then a kept empty one, then
+ *    grows; a free pushes onto the object's own slab (no search)
+ *  - a slab's order is the smallest that wastes at most 1/8 of it
+ *  - large kmalloc blocks are marked by SLAB_PAGE_LARGE in their first
+ *    frame's struct page, with the frame count in private
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/string.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+#include <memory/physical/page.h>
+#include <memory/heap/slab.h>
+
+#define KMALLOC_CLASSES 18U
+
+/* struct page flag on the first frame of a large kmalloc block */
+#define SLAB_PAGE_LARGE 0x01U
+
+/* kmem_cache_t flags */
+#define CACHE_STATIC 0x01U /* size class or cache_cache: never destroyed */
+
+typedef struct slab
+{
+    struct slab *next; /* cache list link */
+    struct slab *prev;
+    kmem_cache_t *cache;
+    void *freelist;    /* first free object */
+    uint32_t inuse;    /* allocated objects */
+    uint32_t reserved;
+} slab_t;
+
+typedef struct
+{
+    slab_t *head;
+    uint64_t count;
+} slab_list_t;
+
+struct kmem_cache
+{
+    const char *name;
+    void (*ctor)(void *obj);
+    uint32_t object_size;      /* as requested */
+    uint32_t stride;           /* distance between objects */
+    uint32_t align;
+    uint32_t free_offset;      /* free list link, from the object start */
+    uint32_t first_offset;     /* first object, from the slab start */
+    uint32_t objects_per_slab;
+    uint32_t order;            /* slab = 2^order frames */
+    uint32_t flags;
+    slab_list_t partial;
+    slab_list_t full;
+    slab_list_t empty;
+    uint64_t active_objects;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t slabs_created;
+    uint64_t slabs_freed;
+    struct kmem_cache *next_cache;
+};
+
+static const uint32_t kmalloc_sizes[KMALLOC_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+    768, 1024, 1536, 2048, 3072, 4096, 6144, 8192};
+
+static const char *const kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-48", "kmalloc-64", "kmalloc-96",
+    "kmalloc-128", "kmalloc-192", "kmalloc-256", "kmalloc-384", "kmalloc-512",
+    "kmalloc-768", "kmalloc-1k", "kmalloc-1.5k", "kmalloc-2k", "kmalloc-3k",
+    "kmalloc-4k", "kmalloc-6k", "kmalloc-8k"};
+
+/* Size class for sizes up to 192, indexed by (size - 1) / 16 */
+static const uint8_t small_class[12] = {0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6};
+
+static kmem_cache_t kmalloc_caches[KMALLOC_CLASSES];
+static kmem_cache_t cache_cache;
+static kmem_cache_t *cache_list = NULL;
+static int slab_ready = 0;
+
+static struct
+{
+    uint64_t requested;    /* bytes asked of kmalloc (size classes only) */
+    uint64_t served;       /* class bytes handed out for them */
+    uint64_t large_allocs;
+    uint64_t large_frames; /* frames held by live large blocks */
+} kmalloc_stats;
+
+static inline uint64_t align_up(uint64_t v, uint64_t a)
+{
+    return (v + a - 1) & ~(a - 1);
+}
+
+static void list_push(slab_list_t *list, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = list->head;
+    if (list->head)
+        list->head->prev = slab;
+    list->head = slab;
+    list->count++;
+}
+
+static void list_remove(slab_list_t *list, slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        list->head = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    list->count--;
+}
+
+/* Smallest order that wastes at most 1/8 of the slab, or -1 if none fits */
+static int pick_order(uint32_t stride, uint32_t first)
+{
+    int best = -1;
+    uint64_t best_waste = 0;
+
+    for (unsigned order = 0; order <= SLAB_MAX_ORDER; order++)
+    {
+        uint64_t bytes = PAGE_SIZE << order;
+        if (bytes < (uint64_t)first + stride)
+            continue;
+
+        uint64_t waste = bytes - (bytes - first) / stride * stride;
+        if (waste * 8 <= bytes)
+            return (int)order;
+
+        /* Otherwise remember the order with the smallest waste fraction */
+        if (best < 0 || waste * (PAGE_SIZE << best) < best_waste * bytes)
+        {
+            best = (int)order;
+            best_waste = waste;
+        }
+    }
+
+    return best;
+}
+
+static int cache_setup(kmem_cache_t *c, const char *name, size_t size, size_t align,
+                       void (*ctor)(void *obj))
+{
+    if (align == 0)
+        align = 8;
+
+    if (size == 0 || (align & (align - 1)) || align > PAGE_SIZE)
+    {
+        kprintf("kmem_cache_create: ERROR - %s: bad size %llu / align %llu\n",
+                name, (uint64_t)size, (uint64_t)align);
+        return -1;
+    }
+
+    /* A free object holds the link itself, unless it must stay constructed */
+    uint64_t free_offset = ctor ? align_up(size, 8) : 0;
+    uint64_t body = ctor ? free_offset + sizeof(void *) : size;
+    if (body < sizeof(void *))
+        body = sizeof(void *);
+
+    uint64_t stride = align_up(body, align < 8 ? 8 : align);
+    uint64_t first = align_up(sizeof(slab_t), align);
+    int order = stride <= (PAGE_SIZE << SLAB_MAX_ORDER) ? pick_order((uint32_t)stride, (uint32_t)first) : -1;
+
+    if (order < 0)
+    {
+        kprintf("kmem_cache_create: ERROR - %s: %llu-byte objects do not fit a slab\n",
+                name, (uint64_t)size);
+        return -1;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    c->ctor = ctor;
+    c->object_size = (uint32_t)size;
+    c->stride = (uint32_t)stride;
+    c->align = (uint32_t)align;
+    c->free_offset = (uint32_t)free_offset;
+    c->first_offset = (uint32_t)first;
+    c->order = (uint32_t)order;
+    c->objects_per_slab = (uint32_t)(((PAGE_SIZE << order) - first) / stride);
+
+    kmem_cache_t **tail = &cache_list;
+    while (*tail)
+        tail = &(*tail)->next_cache;
+    *tail = c;
+
+    return 0;
+}
+
+/* Allocate and format a new slab for c */
+static slab_t *cache_grow(kmem_cache_t *c)
+{
+    uint64_t frames = 1ULL << c->order;
+    uint64_t phys = pmm_alloc_frames(frames, 0);
+    if (!phys)
+        return NULL;
+
+    slab_t *slab = (slab_t *)phys_to_virt(phys);
+    for (uint64_t i = 0; i < frames; i++)
+    {
+        page_t *page = phys_to_page(phys + i * PAGE_SIZE);
+        if (page)
+        {
+            page->type = PAGE_TYPE_SLAB;
+            page->private = (uint64_t)(uintptr_t)slab;
+        }
+    }
+
+    slab->cache = c;
+    slab->inuse = 0;
+
+    /* Thread the free list in address order */
+    unsigned char *obj = (unsigned char *)slab + c->first_offset;
+    void **link = &slab->freelist;
+    for (uint32_t i = 0; i < c->objects_per_slab; i++, obj += c->stride)
+    {
+        if (c->ctor)
+            c->ctor(obj);
+        *link = obj;
+        link = (void **)(obj + c->free_offset);
+    }
+    *link = NULL;
+
+    c->slabs_created++;
+    return slab;
+}
+
+/* Give an empty slab's frames back to the PMM */
+static void cache_release(kmem_cache_t *c, slab_t *slab)
+{
+    pmm_free_frames(virt_to_phys(slab), 1ULL << c->order);
+    c->slabs_freed++;
+}
+
+static void slab_free(slab_t *slab, void *obj)
+{
+    kmem_cache_t *c = slab->cache;
+
+    *(void **)((unsigned char *)obj + c->free_offset) = slab->freelist;
+    slab->freelist = obj;
+    c->active_objects--;
+    c->frees++;
+
+    if (slab->inuse-- == c->objects_per_slab)
+    {
+        list_remove(&c->full, slab);
+        list_push(&c->partial, slab);
+    }
+
+    if (slab->inuse == 0)
+    {
+        list_remove(&c->partial, slab);
+        if (c->empty.count < SLAB_KEEP_EMPTY)
+            list_push(&c->empty, slab);
+        else
+            cache_release(c, slab);
+    }
+}
+
+/* Slab holding obj, or NULL if obj is not in a slab */
+static slab_t *slab_of(const void *obj)
+{
+    page_t *page = virt_to_page(obj);
+
+    if (!page || page->type != PAGE_TYPE_SLAB)
+        return NULL;
+    return (slab_t *)(uintptr_t)page->private;
+}
+
+void __init slab_init(void)
+{
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 64, NULL);
+    cache_cache.flags = CACHE_STATIC;
+
+    for (unsigned i = 0; i < KMALLOC_CLASSES; i++)
+    {
+        uint32_t size = kmalloc_sizes[i];
+        uint32_t align = size & -size; /* largest power of two dividing size */
+
+        if (align > 64)
+            align = 64;
+        cache_setup(&kmalloc_caches[i], kmalloc_names[i], size, align, NULL);
+        kmalloc_caches[i].flags = CACHE_STATIC;
+    }
+
+    slab_ready = 1;
+    kprintf("slab_init: %u size classes (%u - %u B), slabs up to %llu KiB\n",
+            KMALLOC_CLASSES, KMALLOC_MIN_SIZE, KMALLOC_MAX_SIZE,
+            (PAGE_SIZE << SLAB_MAX_ORDER) / 1024);
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *obj))
+{
+    if (!slab_ready)
+    {
+        kprintf("kmem_cache_create: ERROR - slab allocator not initialized\n");
+        return NULL;
+    }
+
+    kmem_cache_t *c = kmem_cache_alloc(&cache_cache);
+    if (!c)
+        return NULL;
+
+    if (cache_setup(c, name, size, align, ctor) != 0)
+    {
+        kmem_cache_free(&cache_cache, c);
+        return NULL;
+    }
+
+    return c;
+}
+
+int kmem_cache_destroy(kmem_cache_t *cache)
+{
+    if (!cache || (cache->flags & CACHE_STATIC))
+    {
+        kprintf("kmem_cache_destroy: ERROR - cache cannot be destroyed\n");
+        return -1;
+    }
+
+    if (cache->active_objects)
+    {
+        kprintf("kmem_cache_destroy: ERROR - %s still has %llu objects\n",
+                cache->name, cache->active_objects);
+        return -1;
+    }
+
+    while (cache->empty.head)
+    {
+        slab_t *slab = cache->empty.head;
+        list_remove(&cache->empty, slab);
+        cache_release(cache, slab);
+    }
+
+    kmem_cache_t **link = &cache_list;
+    while (*link != cache)
+        link = &(*link)->next_cache;
+    *link = cache->next_cache;
+
+    kmem_cache_free(&cache_cache, cache);
+    return 0;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+    slab_t *slab = cache->partial.head;
+
+    if (!slab)
+    {
+        slab = cache->empty.head;
+        if (slab)
+            list_remove(&cache->empty, slab);
+        else if (!(slab = cache_grow(cache)))
+        {
+            kprintf("kmem_cache_alloc: ERROR - %s: out of memory\n", cache->name);
+            return NULL;
+        }
+        list_push(&cache->partial, slab);
+    }
+
+    void *obj = slab->freelist;
+    slab->freelist = *(void **)((unsigned char *)obj + cache->free_offset);
+
+    if (++slab->inuse == cache->objects_per_slab)
+    {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->full, slab);
+    }
+
+    cache->active_objects++;
+    cache->allocs++;
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+    slab_t *slab = slab_of(obj);
+
+    if (!slab || slab->cache != cache)
+    {
+        kprintf("kmem_cache_free: ERROR - %llx does not belong to %s\n",
+                (uint64_t)(uintptr_t)obj, cache->name);
+        return;
+    }
+
+    slab_free(slab, obj);
+}
+
+/* Size class serving `size` bytes (1 .. KMALLOC_MAX_SIZE) */
+static unsigned kmalloc_index(size_t size)
+{
+    if (size <= 192)
+        return small_class[(size - 1) / 16];
+
+    /* 2^(n-1) < size <= 2^n; the classes above 192 are 2^n and 3 * 2^(n-2) */
+    unsigned n = 64 - (unsigned)__builtin_clzll(size - 1);
+    unsigned idx = 7 + 2 * (n - 8);
+
+    return size <= (3ULL << (n - 2)) ? idx - 1 : idx;
+}
+
+static void *kmalloc_large(size_t size)
+{
+    uint64_t frames = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+    uint64_t phys = pmm_alloc_frames(frames, 0);
+    if (!phys)
+        return NULL;
+
+    page_t *page = phys_to_page(phys);
+    if (page)
+    {
+        page->flags |= SLAB_PAGE_LARGE;
+        page->private = frames;
+    }
+
+    kmalloc_stats.large_allocs++;
+    kmalloc_stats.large_frames += frames;
+    return phys_to_virt(phys);
+}
+
+void *kmalloc(size_t size)
+{
+    if (size == 0)
+        return NULL;
+
+    if (!slab_ready)
+    {
+        kprintf("kmalloc: ERROR - slab allocator not initialized\n");
+        return NULL;
+    }
+
+    if (size > KMALLOC_MAX_SIZE)
+        return kmalloc_large(size);
+
+    kmem_cache_t *c = &kmalloc_caches[kmalloc_index(size)];
+    kmalloc_stats.requested += size;
+    kmalloc_stats.served += c->object_size;
+    return kmem_cache_alloc(c);
+}
+
+void *kzalloc(size_t size)
+{
+    void *p = kmalloc(size);
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+void kfree(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    slab_t *slab = slab_of(ptr);
+    if (slab)
+    {
+        slab_free(slab, ptr);
+        return;
+    }
+
+    page_t *page = virt_to_page(ptr);
+    if (page && (page->flags & SLAB_PAGE_LARGE) && ((uintptr_t)ptr & (PAGE_SIZE - 1)) == 0)
+    {
+        uint64_t frames = page->private;
+
+        page->flags &= ~SLAB_PAGE_LARGE;
+        kmalloc_stats.large_frames -= frames;
+        pmm_free_frames(page_to_phys(page), frames);
+        return;
+    }
+
+    kprintf("kfree: ERROR - %llx was not allocated by kmalloc\n", (uint64_t)(uintptr_t)ptr);
+}
+
+void kmem_print_stats(void)
+{
+    uint64_t used_total = 0, held_total = 0;
+
+    kprintf("=== Slab Statistics ===\n");
+    for (kmem_cache_t *c = cache_list; c; c = c->next_cache)
+    {
+        uint64_t slabs = c->partial.count + c->full.count + c->empty.count;
+        uint64_t held = slabs * (PAGE_SIZE << c->order);
+        uint64_t used = c->active_objects * c->object_size;
+
+        used_total += used;
+        held_total += held;
+        if (!c->allocs)
+            continue;
+
+        kprintf("  %s: %llu/%llu objects of %u B, %llu slabs of %llu KiB (%llu empty), "
+                "%llu of %llu KiB used, %llu allocs %llu frees\n",
+                c->name, c->active_objects, slabs * c->objects_per_slab, c->object_size,
+                slabs, (PAGE_SIZE << c->order) / 1024, c->empty.count,
+                used / 1024, held / 1024, c->allocs, c->frees);
+    }
+
+    kprintf("Slabs: %llu of %llu KiB used by objects, %llu KiB held but unused\n",
+            used_total / 1024, held_total / 1024, (held_total - used_total) / 1024);
+    kprintf("kmalloc: %llu B requested, %llu B served by size classes, %llu large blocks "
+            "(%llu frames live)\n",
+            kmalloc_stats.requested, kmalloc_stats.served,
+            kmalloc_stats.large_allocs, kmalloc_stats.large_frames);
+}
@@ -0,0 +1,302 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * bootmem.c - Early bump allocator (arena) and init memory release.
+ * Responsibilities:
+ *  - open arena regions: the first piece of available RAM, outside the
+ *    excluded ranges and the regions already open, that holds the request;
+ *    the first one below boot_map_limit
+ *  - bump-allocate from the newest region; marks / resets / discards
+ *  - free what init did not keep, plus the __init section, to the PMM
+ * Notes:
+ *  - single pass, no free list: a block can only be dropped by resetting
+ *    below it or discarding it
+ *  - opening a region freezes the previous one except for discards; a
+ *    discard that ends at its top still lowers it
+ *  - resetting below a discarded range forgets that discard, since the
+ *    range may be handed out again
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+#include <memory/physical/bootmem.h>
+
+/* Regions in the order they were opened; allocations come from the last */
+static bootmem_range_t spans[BOOTMEM_MAX_REGIONS];
+static uint64_t tops[BOOTMEM_MAX_REGIONS];
+static uint64_t peaks[BOOTMEM_MAX_REGIONS];
+static unsigned region_count = 0;
+static int released = 0;
+
+static bootmem_range_t discards[BOOTMEM_MAX_DISCARDS];
+static unsigned discard_count = 0;
+
+static inline uint64_t align_up(uint64_t v, uint64_t a) { return (v + a - 1) & ~(a - 1); }
+static inline uint64_t align_down(uint64_t v, uint64_t a) { return v & ~(a - 1); }
+
+/* Move addr past every excluded range that contains it */
+static uint64_t skip_excluded(uint64_t addr, const bootmem_range_t *ex, unsigned count)
+{
+    for (int moved = 1; moved;)
+    {
+        moved = 0;
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (addr >= align_down(ex[i].start, PAGE_SIZE) && addr < align_up(ex[i].end, PAGE_SIZE))
+            {
+                addr = align_up(ex[i].end, PAGE_SIZE);
+                moved = 1;
+            }
+        }
+    }
+    return addr;
+}
+
+/* Start of the first excluded range in (addr, end), or end */
+static uint64_t next_excluded(uint64_t addr, uint64_t end, const bootmem_range_t *ex, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        uint64_t s = align_down(ex[i].start, PAGE_SIZE);
+        if (s > addr && s < end)
+            end = s;
+    }
+    return end;
+}
+
+/* Open a region of `bytes` (plus scratch) in the first available piece of
+ * RAM below limit that avoids the excluded ranges and the regions already open
+ */
+static int __init open_region(multiboot_tag_mmap *mm, uint64_t bytes, uint64_t limit,
+                              const bootmem_range_t *exclude, unsigned count)
+{
+    uint32_t entries = (mm->size - sizeof(*mm)) / mm->entry_size;
+
+    if (released || region_count == BOOTMEM_MAX_REGIONS)
+    {
+        kprintf("bootmem: ERROR - cannot open another region (%s)\n",
+                released ? "released" : "table full");
+        return -1;
+    }
+
+    bytes = align_up(bytes, PAGE_SIZE);
+
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        multiboot_mmap_entry *entry = &mm->entries[i];
+        if (entry->type != MULTIBOOT_MMAP_AVAILABLE)
+            continue;
+
+        uint64_t start = align_up(entry->addr, PAGE_SIZE);
+        uint64_t end = align_down(entry->addr + entry->len, PAGE_SIZE);
+        if (end > limit)
+            end = limit;
+
+        while (start < end)
+        {
+            uint64_t prev;
+            do
+            {
+                prev = start;
+                start = skip_excluded(start, exclude, count);
+                start = skip_excluded(start, spans, region_count);
+            } while (start != prev);
+            if (start >= end)
+                break;
+
+            uint64_t seg_end = next_excluded(start, end, exclude, count);
+            seg_end = next_excluded(start, seg_end, spans, region_count);
+            if (seg_end - start >= bytes)
+            {
+                uint64_t want = bytes + BOOTMEM_SCRATCH_BYTES;
+                unsigned r = region_count++;
+
+                spans[r].start = tops[r] = peaks[r] = start;
+                spans[r].end = seg_end - start > want ? start + want : seg_end;
+                kprintf("bootmem: region %u [%llx - %llx] (%llu KiB)\n",
+                        r, spans[r].start, spans[r].end, (spans[r].end - spans[r].start) / 1024);
+                return 0;
+            }
+            start = seg_end;
+        }
+    }
+
+    kprintf("bootmem: ERROR - no region below %llx holds %llu KiB\n", limit, bytes / 1024);
+    return -1;
+}
+
+int __init bootmem_init(multiboot_tag_mmap *mm, uint64_t bytes,
+                        const bootmem_range_t *exclude, unsigned count)
+{
+    if (region_count)
+    {
+        kprintf("bootmem_init: ERROR - already initialized\n");
+        return -1;
+    }
+    return open_region(mm, bytes, boot_map_limit, exclude, count);
+}
+
+int __init bootmem_add_region(multiboot_tag_mmap *mm, uint64_t bytes,
+                              const bootmem_range_t *exclude, unsigned count)
+{
+    return open_region(mm, bytes, ~0ULL, exclude, count);
+}
+
+uint64_t bootmem_alloc(uint64_t size, uint64_t align)
+{
+    if (released || !region_count)
+    {
+        kprintf("bootmem_alloc: ERROR - no arena (%s)\n", released ? "released" : "not initialized");
+        return 0;
+    }
+
+    if (align == 0)
+        align = 8;
+
+    if (align & (align - 1))
+    {
+        kprintf("bootmem_alloc: ERROR - alignment %llx is not a power of two\n", align);
+        return 0;
+    }
+
+    unsigned r = region_count - 1;
+    uint64_t base = align_up(tops[r], align);
+    if (base < tops[r] || base > spans[r].end || size > spans[r].end - base)
+    {
+        kprintf("bootmem_alloc: ERROR - %llu bytes do not fit (%llu KiB left)\n",
+                size, (spans[r].end - tops[r]) / 1024);
+        return 0;
+    }
+
+    tops[r] = base + size;
+    if (tops[r] > peaks[r])
+        peaks[r] = tops[r];
+    return base;
+}
+
+bootmem_mark_t bootmem_mark(void)
+{
+    return region_count ? tops[region_count - 1] : 0;
+}
+
+/* Move the top of region r down to mark, forgetting discards above it */
+static void region_reset(unsigned r, uint64_t mark)
+{
+    tops[r] = mark;
+
+    /* Discards above the new top may be handed out again */
+    unsigned kept = 0;
+    for (unsigned i = 0; i < discard_count; i++)
+    {
+        int in_region = discards[i].start >= spans[r].start && discards[i].end <= spans[r].end;
+
+        if (in_region && discards[i].start >= mark)
+            continue;
+        if (in_region && discards[i].end > align_down(mark, PAGE_SIZE))
+            discards[i].end = align_down(mark, PAGE_SIZE);
+        if (discards[i].end > discards[i].start)
+            discards[kept++] = discards[i];
+    }
+    discard_count = kept;
+}
+
+void bootmem_reset(bootmem_mark_t mark)
+{
+    unsigned r = region_count - 1;
+
+    if (!region_count || mark < spans[r].start || mark > tops[r])
+    {
+        kprintf("bootmem_reset: ERROR - mark %llx is outside the current region\n", mark);
+        return;
+    }
+
+    region_reset(r, mark);
+}
+
+void bootmem_discard(uint64_t start, uint64_t end)
+{
+    unsigned r = 0;
+
+    while (r < region_count && !(start >= spans[r].start && end <= tops[r]))
+        r++;
+
+    if (r == region_count || start >= end)
+    {
+        kprintf("bootmem_discard: ERROR - [%llx - %llx] is not allocated from the arena\n",
+                start, end);
+        return;
+    }
+
+    if (end == tops[r])
+    {
+        region_reset(r, start);
+        return;
+    }
+
+    start = align_up(start, PAGE_SIZE);
+    end = align_down(end, PAGE_SIZE);
+    if (end <= start)
+        return;
+
+    if (discard_count == BOOTMEM_MAX_DISCARDS)
+    {
+        kprintf("bootmem_discard: ERROR - table full, [%llx - %llx] stays reserved\n", start, end);
+        return;
+    }
+
+    discards[discard_count].start = start;
+    discards[discard_count].end = end;
+    discard_count++;
+}
+
+unsigned bootmem_regions(bootmem_range_t *out)
+{
+    for (unsigned r = 0; r < region_count; r++)
+        out[r] = spans[r];
+    return region_count;
+}
+
+void bootmem_release(void)
+{
+    if (released)
+        return;
+    released = 1;
+
+    uint64_t kept = 0;
+    uint64_t peak = 0;
+    uint64_t unused = 0;
+    uint64_t discarded = 0;
+
+    for (unsigned r = 0; r < region_count; r++)
+    {
+        uint64_t tail = align_up(tops[r], PAGE_SIZE);
+        uint64_t tail_bytes = spans[r].end > tail ? spans[r].end - tail : 0;
+
+        if (tail_bytes)
+            pmm_free_frames(tail, tail_bytes / PAGE_SIZE);
+
+        kept += tail - spans[r].start;
+        peak += peaks[r] - spans[r].start;
+        unused += tail_bytes;
+    }
+
+    for (unsigned i = 0; i < discard_count; i++)
+    {
+        pmm_free_frames(discards[i].start, (discards[i].end - discards[i].start) / PAGE_SIZE);
+        discarded += discards[i].end - discards[i].start;
+    }
+
+    /* linker.ld page-aligns both ends of .init */
+    uint64_t init_start = virt_to_phys(__init_start);
+    uint64_t init_bytes = (uint64_t)(__init_end - __init_start);
+    if (init_bytes)
+        pmm_free_frames(init_start, init_bytes / PAGE_SIZE);
+
+    kprintf("bootmem_release: kept %llu KiB of the arena (peak %llu KiB), freed %llu KiB "
+            "unused, %llu KiB discarded, %llu KiB of __init\n",
+            (kept - discarded) / 1024, peak / 1024, unused / 1024, discarded / 1024,
+            init_bytes / 1024);
+}
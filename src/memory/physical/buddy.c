@@ -0,0 +1,234 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * buddy.c - Buddy-system allocator for physical frames.
+ * Responsibilities:
+ *  - keep one free list per order (4 KiB .. 1 GiB blocks)
+ *  - split larger blocks on allocation, coalesce buddies eagerly on free
+ *  - track free blocks per order in small bitmaps for O(1) buddy lookup
+ *  - seed and release arbitrary frame runs as maximal aligned blocks
+ * Notes:
+ *  - list nodes are written into the free frames through the direct map, so
+ *    the kernel page tables must be live before frames are added
+ *  - a bit in free_map[k] is set only for the head frame of a free order-k
+ *    block; bits for frames inside larger free blocks stay clear
+ *  - the nonempty mask turns "find the smallest usable order" into one ctz
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+#include <memory/physical/buddy.h>
+
+static inline buddy_block_t *frame_to_block(uint64_t frame)
+{
+    return (buddy_block_t *)phys_to_virt(frame * PAGE_SIZE);
+}
+
+static inline uint64_t block_to_frame(const buddy_block_t *block)
+{
+    return virt_to_phys(block) / PAGE_SIZE;
+}
+
+/* Number of order-k slots covering [base, base + num) */
+static inline uint64_t order_slots(uint64_t base, uint64_t num, unsigned order)
+{
+    return ((base + num - 1) >> order) - (base >> order) + 1;
+}
+
+static inline uint64_t slot_of(const buddy_allocator_t *b, uint64_t frame, unsigned order)
+{
+    return (frame >> order) - (b->base_frame >> order);
+}
+
+static inline int test_free(const buddy_allocator_t *b, uint64_t frame, unsigned order)
+{
+    uint64_t slot = slot_of(b, frame, order);
+    return (b->free_map[order][slot >> 6] >> (slot & 63)) & 1;
+}
+
+static inline void list_push(buddy_allocator_t *b, uint64_t frame, unsigned order)
+{
+    buddy_block_t *head = &b->free_lists[order];
+    buddy_block_t *block = frame_to_block(frame);
+
+    block->next = head->next;
+    block->prev = head;
+    head->next->prev = block;
+    head->next = block;
+
+    uint64_t slot = slot_of(b, frame, order);
+    b->free_map[order][slot >> 6] |= 1ULL << (slot & 63);
+    b->free_count[order]++;
+    b->nonempty |= 1U << order;
+}
+
+static inline void list_remove(buddy_allocator_t *b, uint64_t frame, unsigned order)
+{
+    buddy_block_t *block = frame_to_block(frame);
+
+    block->prev->next = block->next;
+    block->next->prev = block->prev;
+
+    uint64_t slot = slot_of(b, frame, order);
+    b->free_map[order][slot >> 6] &= ~(1ULL << (slot & 63));
+    if (--b->free_count[order] == 0)
+        b->nonempty &= ~(1U << order);
+}
+
+uint64_t buddy_storage_bytes(uint64_t base_frame, uint64_t num_frames)
+{
+    if (num_frames == 0)
+        return 0;
+
+    uint64_t words = 0;
+    for (unsigned order = 0; order < BUDDY_ORDERS; order++)
+        words += (order_slots(base_frame, num_frames, order) + 63) / 64;
+
+    return words * sizeof(uint64_t);
+}
+
+void __init buddy_init(buddy_allocator_t *b, void *storage, uint64_t base_frame, uint64_t num_frames)
+{
+    uint64_t *words = (uint64_t *)storage;
+
+    b->base_frame = base_frame;
+    b->num_frames = num_frames;
+    b->free_frames = 0;
+    b->nonempty = 0;
+
+    for (unsigned order = 0; order < BUDDY_ORDERS; order++)
+    {
+        b->free_lists[order].next = &b->free_lists[order];
+        b->free_lists[order].prev = &b->free_lists[order];
+        b->free_count[order] = 0;
+        b->free_map[order] = NULL;
+
+        if (num_frames == 0)
+            continue;
+
+        uint64_t n = (order_slots(base_frame, num_frames, order) + 63) / 64;
+        b->free_map[order] = words;
+        for (uint64_t i = 0; i < n; i++)
+            words[i] = 0;
+        words += n;
+    }
+}
+
+int64_t buddy_alloc(buddy_allocator_t *b, unsigned order)
+{
+    if (order > BUDDY_MAX_ORDER)
+        return -1;
+
+    uint32_t usable = b->nonempty & (~0U << order);
+    if (!usable)
+        return -1;
+
+    unsigned k = (unsigned)__builtin_ctz(usable);
+    uint64_t frame = block_to_frame(b->free_lists[k].next);
+    list_remove(b, frame, k);
+
+    /* Split down, returning the upper halves to the lower lists */
+    while (k > order)
+    {
+        k--;
+        list_push(b, frame + (1ULL << k), k);
+    }
+
+    b->free_frames -= 1ULL << order;
+    return (int64_t)frame;
+}
+
+void buddy_free(buddy_allocator_t *b, uint64_t frame, unsigned order)
+{
+    if (order > BUDDY_MAX_ORDER || (frame & ((1ULL << order) - 1)) ||
+        frame < b->base_frame || frame + (1ULL << order) > b->base_frame + b->num_frames)
+    {
+        kprintf("buddy_free: ERROR - bad block (frame %llu, order %u)\n", frame, order);
+        return;
+    }
+
+    if (test_free(b, frame, order))
+    {
+        kprintf("buddy_free: ERROR - double free (frame %llu, order %u)\n", frame, order);
+        return;
+    }
+
+    b->free_frames += 1ULL << order;
+
+    /* Coalesce with the buddy while it is free at the same order */
+    while (order < BUDDY_MAX_ORDER)
+    {
+        uint64_t buddy = frame ^ (1ULL << order);
+        if (buddy < b->base_frame || buddy + (1ULL << order) > b->base_frame + b->num_frames)
+            break;
+        if (!test_free(b, buddy, order))
+            break;
+
+        list_remove(b, buddy, order);
+        frame &= ~(1ULL << order);
+        order++;
+    }
+
+    list_push(b, frame, order);
+}
+
+void buddy_free_range(buddy_allocator_t *b, uint64_t frame, uint64_t count)
+{
+    while (count)
+    {
+        /* Largest block that is aligned at `frame` and fits in `count` */
+        unsigned order = frame ? (unsigned)__builtin_ctzll(frame) : BUDDY_MAX_ORDER;
+        unsigned fit = 63U - (unsigned)__builtin_clzll(count);
+        if (order > fit)
+            order = fit;
+        if (order > BUDDY_MAX_ORDER)
+            order = BUDDY_MAX_ORDER;
+
+        buddy_free(b, frame, order);
+        frame += 1ULL << order;
+        count -= 1ULL << order;
+    }
+}
+
+int64_t buddy_alloc_frames(buddy_allocator_t *b, uint64_t count, uint64_t align_frames)
+{
+    if (count == 0 || align_frames == 0 || (align_frames & (align_frames - 1)))
+        return -1;
+
+    /* Smallest order that covers both the size and the alignment */
+    unsigned order = 0;
+    while ((1ULL << order) < count || (1ULL << order) < align_frames)
+    {
+        if (++order > BUDDY_MAX_ORDER)
+            return -1;
+    }
+
+    int64_t frame = buddy_alloc(b, order);
+    if (frame < 0)
+        return -1;
+
+    /* Give back the tail we do not need */
+    uint64_t excess = (1ULL << order) - count;
+    if (excess)
+        buddy_free_range(b, (uint64_t)frame + count, excess);
+
+    return frame;
+}
+
+void buddy_print_stats(const buddy_allocator_t *b)
+{
+    kprintf("Buddy: %llu free frames in [%llx - %llx]\n",
+            b->free_frames,
+            b->base_frame * PAGE_SIZE,
+            (b->base_frame + b->num_frames) * PAGE_SIZE);
+
+    for (unsigned order = 0; order < BUDDY_ORDERS; order++)
+    {
+        if (b->free_count[order])
+            kprintf("  order %u (%llu KB): %llu blocks\n",
+                    order, (PAGE_SIZE << order) / 1024, b->free_count[order]);
+    }
+}
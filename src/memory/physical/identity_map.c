@@ -1,22 +1,41 @@
 /*
  * Licensed under MIT License - URIX project.
- * identity_map.c - Build 4-level page tables for identity mapping (4KB pages).
+ * identity_map.c - Build the kernel's 4-level page tables (1G/2M/4K pages).
  * Responsibilities:
- *  - allocate pages for page tables within a given physical range
- *  - build PML4/PDPT/PD/PT hierarchy for identity mapping
- *  - map virtual addresses to the same physical addresses for low memory
+ *  - allocate pages for page tables within a given physical range, falling
+ *    back to the PMM once our map is live and that reserve is exhausted
+ *  - map_range: map a virt -> phys range, descending once per table and
+ *    filling runs of leaf entries in a tight loop
+ *  - build the direct map of all RAM at PHYS_MAP_BASE and the kernel image
+ *    window at KERNEL_VMA, using 1 GiB PDPT entries (CPUID pdpe1gb) or 2 MiB
+ *    PD entries wherever alignment allows
  *  - provide diagnostic printing of allocator and mapping progress
  * Notes:
- *  - relies on early identity mapping for addresses below EARLY_IDENTITY_LIMIT
- *  - zeroing of allocated pages is skipped if beyond early identity map
+ *  - page tables are accessed through the direct map; before the new CR3 is
+ *    live, only the boot tables' first boot_map_limit bytes are there
+ *  - every page-table page is zeroed; PMM fallback pages come from the
+ *    zero pool and are already clear. A reserve page the boot tables do not
+ *    map cannot be zeroed, so allocating it fails.
+ *  - kernel_map_all runs before the PMM is initialized, so the reserve is
+ *    sized for the worst case (kernel_map_reserve_bytes); running out of it
+ *    during the build is fatal
+ *  - pt_alloc_trim ends the reserve so its unused tail can go back to the PMM
  *  - includes helper functions to extract indices and physical addresses from PTEs
- *  - switches CR3 to new PML4 after mapping completion
+ *  - the first DIRECT_MAP_SMALL_END bytes (IVT/BDA, EBDA, VGA hole, BIOS
+ *    ROM) always use 4 KiB pages so no large page spans those legacy ranges
+ *  - the new tables drop the boot identity map; nothing may use low virtual
+ *    addresses after kernel_map_all switches CR3
  */
 
 #include <stdint.h>
 #include <stddef.h>
 #include <lib/print.h>
+#include <lib/init.h>
 #include <lib/string.h> /* memset */
+#include <lib/cpu_features.h>
+#include <lib/tsc.h>
+#include <lib/cpu_regs.h>
+#include <memory/layout.h>
 #include <memory/physical/pmm.h>
 #include <memory/physical/identity_map.h>
 
@@ -24,6 +43,21 @@
 static uint64_t pt_alloc_next = 0;
 static uint64_t pt_alloc_limit = 0;
 static uint64_t pt_alloc_start_saved = 0;
+static uint64_t pt_alloc_limit_saved = 0;
+
+/* Pages taken from the PMM after the reserve ran out */
+static uint64_t pt_alloc_fallback_pages = 0;
+
+/* Set once our own direct map (covering all RAM) is loaded in CR3 */
+static int kernel_map_active = 0;
+
+/* Leaf entries written by map_range, by page size */
+static struct
+{
+    uint64_t pages_1g;
+    uint64_t pages_2m;
+    uint64_t pages_4k;
+} map_stats;
 
 static inline unsigned pml4_idx(uint64_t addr) { return (addr >> 39) & 0x1FF; }
 static inline unsigned pdpt_idx(uint64_t addr) { return (addr >> 30) & 0x1FF; }
@@ -33,12 +67,16 @@ static inline unsigned pt_idx(uint64_t addr) { return (addr >> 12) & 0x1FF; }
 /* Extract physical address from PTE (clear flags) */
 static inline uint64_t pte_to_phys(uint64_t entry) { return entry & 0x000FFFFFFFFFF000ULL; }
 
-void pt_alloc_init(uint64_t start_phys, uint64_t limit_phys)
+static inline uint64_t div_round_up(uint64_t x, uint64_t divisor) { return (x + divisor - 1) / divisor; }
+
+void __init pt_alloc_init(uint64_t start_phys, uint64_t limit_phys)
 {
     /* Align to page boundaries */
     pt_alloc_next = (start_phys + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     pt_alloc_limit = limit_phys & ~(PAGE_SIZE - 1);
     pt_alloc_start_saved = pt_alloc_next;
+    pt_alloc_limit_saved = pt_alloc_limit;
+    pt_alloc_fallback_pages = 0;
 
     kprintf("pt_alloc_init: range [%llx - %llx] (%llu KiB)\n",
             (uint64_t)pt_alloc_next,
@@ -46,42 +84,70 @@ void pt_alloc_init(uint64_t start_phys, uint64_t limit_phys)
             (uint64_t)((pt_alloc_limit - pt_alloc_next) / 1024ULL));
 }
 
-uint64_t pt_alloc_page_phys(void)
+/* Zero one page-table page (PMM frames are recycled, so never assume zero) */
+static inline void pt_zero_page(uint64_t phys)
 {
-    /* Check available space */
-    if (pt_alloc_next + PAGE_SIZE > pt_alloc_limit)
+    memset(phys_to_virt(phys), 0, PAGE_SIZE);
+}
+
+/* Reserve exhausted: take a zeroed frame from the PMM instead. Only possible
+ * once our map is live; kernel_map_all runs before the PMM exists.
+ */
+static uint64_t pt_alloc_fallback(void)
+{
+    if (!kernel_map_active)
+    {
+        kprintf("CRITICAL: page-table reserve undersized (%llu KiB used)\n",
+                (uint64_t)((pt_alloc_next - pt_alloc_start_saved) / 1024ULL));
+        return 0;
+    }
+
+    uint64_t page = pmm_alloc_zeroed_frame();
+    if (!page)
     {
         kprintf("CRITICAL: Page table allocator exhausted\n");
-        kprintf("  Next: %llx, Limit: %llx\n",
-                (uint64_t)pt_alloc_next,
-                (uint64_t)pt_alloc_limit);
-        kprintf("  Used: %llu KiB of %llu KiB\n",
-                (uint64_t)((pt_alloc_next - pt_alloc_start_saved) / 1024ULL),
-                (uint64_t)((pt_alloc_limit - pt_alloc_start_saved) / 1024ULL));
+        kprintf("  Reserve: %llu KiB used, PMM fallback failed\n",
+                (uint64_t)((pt_alloc_next - pt_alloc_start_saved) / 1024ULL));
         return 0;
     }
 
+    pt_alloc_fallback_pages++;
+    return page;
+}
+
+uint64_t pt_alloc_page_phys(void)
+{
+    /* Fallback pages are already zero */
+    if (pt_alloc_next + PAGE_SIZE > pt_alloc_limit)
+        return pt_alloc_fallback();
+
     uint64_t page = pt_alloc_next;
-    pt_alloc_next += PAGE_SIZE;
 
-    if (page < EARLY_IDENTITY_LIMIT)
+    /* Cannot be zeroed before our map is live, and a table with stale
+     * entries must never be handed out
+     */
+    if (page >= boot_map_limit && !kernel_map_active)
     {
-        void *v = (void *)(uintptr_t)page;
-        // memset(v, 0, PAGE_SIZE);
-    }
-    else
-    {
-        kprintf("WARNING: Allocated PT page at %llx beyond early identity map\n",
-                (unsigned long long)page);
+        kprintf("CRITICAL: page-table reserve at %llx lies beyond the boot map (%llx)\n",
+                page, boot_map_limit);
+        return 0;
     }
 
+    pt_alloc_next += PAGE_SIZE;
+    pt_zero_page(page);
     return page;
 }
 
+uint64_t pt_alloc_trim(void)
+{
+    pt_alloc_limit = pt_alloc_next;
+    return pt_alloc_next;
+}
+
 void pt_alloc_print_usage(void)
 {
     uint64_t used = pt_alloc_next - pt_alloc_start_saved;
-    uint64_t total = pt_alloc_limit - pt_alloc_start_saved;
+    uint64_t total = pt_alloc_limit_saved - pt_alloc_start_saved;
     uint64_t percent = total > 0 ? (used * 100ULL) / total : 0;
 
     kprintf("Page table usage: %llu / %llu bytes (%llu%) = %llu KB\n",
@@ -89,46 +155,218 @@ void pt_alloc_print_usage(void)
             (uint64_t)total,
             (uint64_t)percent,
             (uint64_t)(used / 1024ULL));
+    if (pt_alloc_fallback_pages)
+        kprintf("  plus %llu pages (%llu KB) from the PMM after the reserve ran out\n",
+                pt_alloc_fallback_pages, pt_alloc_fallback_pages * PAGE_SIZE / 1024ULL);
 }
 
-/* Build identity map for addresses [0 .. map_end) using 4KB pages.
- * pt_alloc_start/limit specify the physical range used for PT pages.
+/* Return the table that table[idx] points to, allocating it if not present.
+ * Returns NULL (after printing) if no page is left or a large page is in the way.
  */
-int identity_map_all(uint64_t map_end, uint64_t pt_alloc_start, uint64_t pt_alloc_limit)
+static uint64_t *pt_next_level(uint64_t *table, unsigned idx, uint64_t table_flags, uint64_t virt)
 {
-    if (map_end == 0)
+    uint64_t entry = table[idx];
+    if (entry & PAGE_PRESENT)
+    {
+        if (entry & PAGE_HUGE)
+        {
+            kprintf("map_range: ERROR - %llx is already covered by a large page\n", virt);
+            return NULL;
+        }
+        return (uint64_t *)phys_to_virt(pte_to_phys(entry));
+    }
+
+    uint64_t phys = pt_alloc_page_phys();
+    if (!phys)
+    {
+        kprintf("map_range: ERROR - failed to allocate page table at virt %llx\n", virt);
+        return NULL;
+    }
+
+    table[idx] = phys | table_flags;
+    return (uint64_t *)phys_to_virt(phys);
+}
+
+/* End of the naturally aligned block of `size` bytes holding addr, capped at end */
+static inline uint64_t block_end(uint64_t addr, uint64_t size, uint64_t end)
+{
+    uint64_t next = (addr & ~(size - 1)) + size;
+    return (next > addr && next < end) ? next : end;
+}
+
+/* Number of entries from table[idx] (at most max) that can become large leaves,
+ * i.e. that do not already point to a lower-level table
+ */
+static inline unsigned leaf_run(const uint64_t *table, unsigned idx, unsigned max)
+{
+    unsigned n = 0;
+    while (n < max && (table[idx + n] & (PAGE_PRESENT | PAGE_HUGE)) != PAGE_PRESENT)
+        n++;
+    return n;
+}
+
+/* Write `count` consecutive leaf entries starting at table[idx] */
+static inline void fill_entries(uint64_t *table, unsigned idx, unsigned count,
+                                uint64_t phys, uint64_t flags, uint64_t step)
+{
+    uint64_t *e = table + idx;
+    for (unsigned k = 0; k < count; k++)
+        e[k] = (phys + (uint64_t)k * step) | flags;
+}
+
+int map_range(uint64_t *pml4, uint64_t virt, uint64_t phys, uint64_t len, uint64_t flags)
+{
+    if ((virt | phys | len) & (PAGE_SIZE - 1))
     {
-        kprintf("identity_map_all: ERROR - map_end is 0\n");
+        kprintf("map_range: ERROR - unaligned range (virt %llx, phys %llx, len %llx)\n",
+                virt, phys, len);
         return -1;
     }
 
-    if ((uint64_t)PAGE_SIZE == 0)
+    if (len == 0)
+        return 0;
+
+    if (virt + len < virt)
     {
-        kprintf("identity_map_all: ERROR - PAGE_SIZE is 0 or undefined\n");
+        kprintf("map_range: ERROR - range at %llx wraps\n", virt);
         return -1;
     }
 
-    /* Ensure we have an allocator range inside identity mapped area */
-    if (pt_alloc_start >= EARLY_IDENTITY_LIMIT)
+    static int use_1g = -1;
+    if (use_1g < 0)
+        use_1g = cpu_has(X86_FEATURE_PDPE1GB);
+
+    int huge = (flags & PAGE_HUGE) != 0;
+    uint64_t leaf_flags = flags & ~PAGE_HUGE;
+    uint64_t table_flags = PAGE_PRESENT_RW | (flags & PAGE_USER);
+    uint64_t end = virt + len;
+
+    while (virt < end)
     {
-        kprintf("identity_map_all: ERROR - PT alloc start %llx >= EARLY_IDENTITY_LIMIT %llx\n",
-                (uint64_t)pt_alloc_start, (uint64_t)EARLY_IDENTITY_LIMIT);
+        uint64_t *pdpt = pt_next_level(pml4, pml4_idx(virt), table_flags, virt);
+        if (!pdpt)
+            return -1;
+
+        uint64_t l4_end = block_end(virt, 512ULL * PAGE_SIZE_1G, end);
+        while (virt < l4_end)
+        {
+            /* Run of 1 GiB pages */
+            unsigned i3 = pdpt_idx(virt);
+            unsigned n = 0;
+            if (huge && use_1g && !((virt | phys) & (PAGE_SIZE_1G - 1)))
+                n = leaf_run(pdpt, i3, (unsigned)((l4_end - virt) / PAGE_SIZE_1G));
+            if (n)
+            {
+                fill_entries(pdpt, i3, n, phys, leaf_flags | PAGE_HUGE, PAGE_SIZE_1G);
+                map_stats.pages_1g += n;
+                virt += (uint64_t)n * PAGE_SIZE_1G;
+                phys += (uint64_t)n * PAGE_SIZE_1G;
+                continue;
+            }
+
+            uint64_t *pd = pt_next_level(pdpt, i3, table_flags, virt);
+            if (!pd)
+                return -1;
+
+            uint64_t l3_end = block_end(virt, PAGE_SIZE_1G, l4_end);
+            while (virt < l3_end)
+            {
+                /* Run of 2 MiB pages */
+                unsigned i2 = pd_idx(virt);
+                n = 0;
+                if (huge && !((virt | phys) & (PAGE_SIZE_2M - 1)))
+                    n = leaf_run(pd, i2, (unsigned)((l3_end - virt) / PAGE_SIZE_2M));
+                if (n)
+                {
+                    fill_entries(pd, i2, n, phys, leaf_flags | PAGE_HUGE, PAGE_SIZE_2M);
+                    map_stats.pages_2m += n;
+                    virt += (uint64_t)n * PAGE_SIZE_2M;
+                    phys += (uint64_t)n * PAGE_SIZE_2M;
+                    continue;
+                }
+
+                uint64_t *pt = pt_next_level(pd, i2, table_flags, virt);
+                if (!pt)
+                    return -1;
+
+                /* Fill the rest of this leaf table in one go */
+                uint64_t l2_end = block_end(virt, PAGE_SIZE_2M, l3_end);
+                n = (unsigned)((l2_end - virt) / PAGE_SIZE);
+                fill_entries(pt, pt_idx(virt), n, phys, leaf_flags, PAGE_SIZE);
+                map_stats.pages_4k += n;
+                virt += (uint64_t)n * PAGE_SIZE;
+                phys += (uint64_t)n * PAGE_SIZE;
+            }
+        }
+    }
+
+    return 0;
+}
+
+uint64_t __init kernel_map_reserve_bytes(uint64_t map_end, uint64_t kernel_end)
+{
+    /* Worst case is 2 MiB pages everywhere: one PD per GiB, plus one PT for
+     * the 4 KiB window and one for an unaligned tail, in both mappings
+     */
+    uint64_t pages = 1;
+    pages += div_round_up(map_end, 512ULL * PAGE_SIZE_1G) + div_round_up(map_end, PAGE_SIZE_1G) + 2;
+    pages += 1 + div_round_up(kernel_end, PAGE_SIZE_1G) + 2;
+    return pages * PAGE_SIZE;
+}
+
+/* Map phys [0, end) at virt_base: 4 KiB pages below DIRECT_MAP_SMALL_END,
+ * the largest pages that fit above it. Kernel mappings are global so they
+ * survive address-space switches once tlb_init sets CR4.PGE.
+ */
+static int __init map_window(uint64_t *pml4, uint64_t virt_base, uint64_t end)
+{
+    uint64_t small_end = end < DIRECT_MAP_SMALL_END ? end : DIRECT_MAP_SMALL_END;
+    uint64_t flags = PAGE_PRESENT_RW | PAGE_GLOBAL;
+
+    if (map_range(pml4, virt_base, 0, small_end, flags) != 0)
+        return -1;
+    return map_range(pml4, virt_base + small_end, small_end, end - small_end,
+                     flags | PAGE_HUGE);
+}
+
+/* Build the kernel page tables: phys [0 .. map_end) at PHYS_MAP_BASE and the
+ * kernel image [0 .. kernel_end) at KERNEL_VMA, using the largest page size
+ * that fits (1 GiB if the CPU has pdpe1gb, else 2 MiB, else 4 KiB).
+ * pt_alloc_start/limit specify the physical range used for PT pages.
+ */
+int __init kernel_map_all(uint64_t map_end, uint64_t kernel_end, uint64_t pt_alloc_start, uint64_t pt_alloc_limit)
+{
+    if (map_end == 0)
+    {
+        kprintf("kernel_map_all: ERROR - map_end is 0\n");
         return -1;
     }
 
-    if (pt_alloc_limit > EARLY_IDENTITY_LIMIT)
+    /* Ensure we have an allocator range inside the boot direct map */
+    if (pt_alloc_start >= boot_map_limit)
     {
-        kprintf("identity_map_all: WARNING - limiting PT alloc limit %llx to EARLY_IDENTITY_LIMIT %llx\n",
-                (uint64_t)pt_alloc_limit, (uint64_t)EARLY_IDENTITY_LIMIT);
-        pt_alloc_limit = EARLY_IDENTITY_LIMIT;
+        kprintf("kernel_map_all: ERROR - PT alloc start %llx >= boot map limit %llx\n",
+                (uint64_t)pt_alloc_start, boot_map_limit);
+        return -1;
     }
 
-    /* Round up map_end to page boundary */
+    if (pt_alloc_limit > boot_map_limit)
+    {
+        kprintf("kernel_map_all: WARNING - limiting PT alloc limit %llx to boot map limit %llx\n",
+                (uint64_t)pt_alloc_limit, boot_map_limit);
+        pt_alloc_limit = boot_map_limit;
+    }
+
+    /* Round up to page / large page boundaries */
     map_end = (map_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    kernel_end = (kernel_end + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
 
-    kprintf("identity_map_all: mapping [0x0 - %llx] (%llu MiB)\n",
+    kprintf("kernel_map_all: direct map [0x0 - %llx] (%llu MiB) at %llx, kernel [0x0 - %llx] at %llx\n",
             (uint64_t)map_end,
-            (uint64_t)(map_end / (1024ULL * 1024ULL)));
+            (uint64_t)(map_end / (1024ULL * 1024ULL)),
+            (uint64_t)PHYS_MAP_BASE,
+            (uint64_t)kernel_end,
+            (uint64_t)KERNEL_VMA);
 
     /* Initialize allocator */
     pt_alloc_init(pt_alloc_start, pt_alloc_limit);
@@ -137,114 +375,39 @@ int identity_map_all(uint64_t map_end, uint64_t pt_alloc_start, uint64_t pt_allo
     uint64_t pml4_phys = pt_alloc_page_phys();
     if (!pml4_phys)
     {
-        kprintf("identity_map_all: ERROR - failed to allocate PML4\n");
+        kprintf("kernel_map_all: ERROR - failed to allocate PML4\n");
         return -1;
     }
 
-    uint64_t *pml4 = (uint64_t *)(uintptr_t)pml4_phys;
-    /* (we zeroed in pt_alloc_page_phys) */
-    kprintf("identity_map_all: PML4 at %llx\n", (uint64_t)pml4_phys);
+    uint64_t *pml4 = (uint64_t *)phys_to_virt(pml4_phys);
+    /* (zeroed in pt_alloc_page_phys) */
+    kprintf("kernel_map_all: PML4 at %llx, using %s pages\n",
+            (uint64_t)pml4_phys, cpu_has(X86_FEATURE_PDPE1GB) ? "1 GiB" : "2 MiB");
+
+    map_stats.pages_1g = map_stats.pages_2m = map_stats.pages_4k = 0;
+    uint64_t start_tsc = rdtsc();
 
-    uint64_t last_reported_mb = 0;
-    uint64_t step = PAGE_SIZE;
-    if (step == 0)
+    if (map_window(pml4, PHYS_MAP_BASE, map_end) != 0 ||
+        map_window(pml4, KERNEL_VMA, kernel_end) != 0)
     {
-        kprintf("identity_map_all: ERROR - PAGE_SIZE == 0\n");
+        kprintf("kernel_map_all: ERROR - mapping failed\n");
         return -1;
     }
 
-    for (uint64_t addr = 0; addr < map_end; addr += step)
-    {
-        /* Progress every 256 MiB */
-        uint64_t current_mb = addr / (1024ULL * 1024ULL);
-        if (current_mb >= last_reported_mb + 256ULL)
-        {
-            kprintf("  mapped up to %llu MiB...\n", (uint64_t)current_mb);
-            last_reported_mb = current_mb;
-        }
-
-        unsigned i4 = pml4_idx(addr);
-        unsigned i3 = pdpt_idx(addr);
-        unsigned i2 = pd_idx(addr);
-        unsigned i1 = pt_idx(addr);
-
-        /* create PDPT */
-        uint64_t *pdpt;
-        if (!(pml4[i4] & PAGE_PRESENT))
-        {
-            uint64_t pdpt_phys = pt_alloc_page_phys();
-            if (!pdpt_phys)
-            {
-                kprintf("identity_map_all: ERROR - failed to allocate PDPT at addr %llx\n",
-                        (unsigned long long)addr);
-                return -1;
-            }
-            // memset((void *)(uintptr_t)pdpt_phys, 0, PAGE_SIZE);
-            pml4[i4] = pdpt_phys | PAGE_PRESENT_RW;
-            pdpt = (uint64_t *)(uintptr_t)pdpt_phys;
-        }
-        else
-        {
-            pdpt = (uint64_t *)(uintptr_t)pte_to_phys(pml4[i4]);
-        }
-
-        /* create PD */
-        uint64_t *pd;
-        if (!(pdpt[i3] & PAGE_PRESENT))
-        {
-            uint64_t pd_phys = pt_alloc_page_phys();
-            if (!pd_phys)
-            {
-                kprintf("identity_map_all: ERROR - failed to allocate PD at addr %llx\n",
-                        (uint64_t)addr);
-                return -1;
-            }
-            // memset((void *)(uintptr_t)pd_phys, 0, PAGE_SIZE);
-            pdpt[i3] = pd_phys | PAGE_PRESENT_RW;
-            pd = (uint64_t *)(uintptr_t)pd_phys;
-        }
-        else
-        {
-            pd = (uint64_t *)(uintptr_t)pte_to_phys(pdpt[i3]);
-        }
-
-        /* create PT */
-        uint64_t *pt;
-        if (!(pd[i2] & PAGE_PRESENT))
-        {
-            uint64_t pt_phys = pt_alloc_page_phys();
-            if (!pt_phys)
-            {
-                kprintf("identity_map_all: ERROR - failed to allocate PT at addr %llx\n",
-                        (uint64_t)addr);
-                return -1;
-            }
-            // memset((void *)(uintptr_t)pt_phys, 0, PAGE_SIZE);
-            pd[i2] = pt_phys | PAGE_PRESENT_RW;
-            pt = (uint64_t *)(uintptr_t)pt_phys;
-        }
-        else
-        {
-            pt = (uint64_t *)(uintptr_t)pte_to_phys(pd[i2]);
-        }
-
-        /* Create final mapping (identity map the 4KB page). */
-        pt[i1] = (addr & ~0xFFFULL) | PAGE_PRESENT_RW;
-    }
+    uint64_t end_tsc = rdtsc();
 
-    kprintf("identity_map_all: finished mapping all pages\n");
+    kprintf("kernel_map_all: finished mapping all pages\n");
+    kprintf("  %llu x 1 GiB, %llu x 2 MiB, %llu x 4 KiB pages in %llu cycles\n",
+            map_stats.pages_1g, map_stats.pages_2m, map_stats.pages_4k, end_tsc - start_tsc);
     pt_alloc_print_usage();
 
     /* Switch CR3 to new PML4 */
-    kprintf("identity_map_all: switching to new CR3 (%llx)...\n", (uint64_t)pml4_phys);
+    kprintf("kernel_map_all: switching to new CR3 (%llx)...\n", (uint64_t)pml4_phys);
 
-    __asm__ volatile(
-        "mov %0, %%rax\n\t"
-        "mov %%rax, %%cr3\n\t"
-        : /* no outputs */
-        : "r"(pml4_phys)
-        : "rax", "memory");
+    /* CR4.PGE is still off, so this drops the boot tables' entries too */
+    write_cr3(pml4_phys);
 
-    kprintf("identity_map_all: SUCCESS - new page tables active\n");
+    kernel_map_active = 1;
+    kprintf("kernel_map_all: SUCCESS - new page tables active\n");
     return 0;
 }
@@ -2,8 +2,8 @@
  * Licensed under MIT License - URIX project.
  * pmm.c - Physical Memory Manager with 4KB pages.
  * Responsibilities:
- *  - manage physical memory using a bitmap of 4KB frames
- *  - allocate and free individual physical frames
+ *  - manage physical memory using a sparse, sectioned bitmap of 4KB frames
+ *  - allocate and free individual physical frames and aligned contiguous runs
  *  - track total, free, and used memory
  *  - reserve memory for kernel, page tables, multiboot structures, and bitmap itself
  *  - build early identity mapping for low memory region
@@ -13,66 +13,525 @@
  *  - bitmap stores allocation state (1=used, 0=free) for each 4KB frame
  *  - ensures allocated frames are page-aligned
  *  - skips freeing frame 0
- *  - uses last-allocation optimization to speed up sequential allocations
- *  - marks non-usable memory and reserved regions as used
- *  - depends on identity_map.c for building early identity mapping
+ *  - bitmaps exist only for 128 MiB sections that contain usable RAM, so
+ *    memory-map holes cost one directory slot instead of bitmap space
+ *  - per-section summary words (one bit per 64-frame leaf word) and one
+ *    "has free" bit per section let allocation find a free frame with a
+ *    few ctz steps at any fill level
+ *  - splits frames into DMA (<16 MiB), DMA32 (<4 GiB) and NORMAL zones, each
+ *    with its own free counter, search cursor and low watermark; requests
+ *    fall back NORMAL -> DMA32 -> DMA but never drain a lower zone's reserve
+ *  - uses a per-zone last-allocation cursor to speed up sequential allocations
+ *  - with PMM_BACKEND_BUDDY the bitmap only describes boot-time state; once
+ *    reserved regions are marked, its free runs seed buddy.c, which then
+ *    serves every allocation (one buddy instance per zone)
+ *  - starts with every frame used, frees the available mmap ranges, then
+ *    marks reserved regions used; all range marking is word-granular, with
+ *    one popcount-based counter delta per zone
+ *  - the kernel page tables (direct map + kernel window) are built first, from
+ *    a bootmem reserve below boot_map_limit sized for them; only the part
+ *    actually used stays reserved, and the bitmap and page map then come
+ *    from a second bootmem region anywhere in RAM
+ *  - the bootmem arena stays reserved until bootmem_release
+ *  - every frame in a present section also has a 32-byte struct page
+ *    (page.h), stored after the bitmap; allocation sets refcount 1, free
+ *    resets it, and page_put frees the frame on the last reference
+ *  - all frame contents (bitmap, buddy lists) are reached via phys_to_virt
+ *  - depends on identity_map.c for building the kernel page tables
  */
 
 
 #include <multiboot2.h>
 #include <memory/physical/pmm.h>
+#include <memory/physical/page.h>
+#include <memory/layout.h>
 #include <memory/physical/identity_map.h>
+#include <memory/physical/buddy.h>
+#include <memory/physical/bootmem.h>
+#include <lib/init.h>
 #include <lib/print.h>
 #include <lib/string.h>
+#include <lib/tsc.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/* Physical bounds of the kernel image (linker.ld) */
 extern char _kernel_start;
 extern char _kernel_end;
 
-/* Bitmap state */
-static uint8_t *bitmap = NULL;
+/* Bitmap state
+ * The frame space is cut into 128 MiB sections. Only sections that contain
+ * usable RAM get a bitmap, so overhead follows installed memory rather than
+ * the highest address. Three levels:
+ *  - section bitmap:  leaf words, one bit per frame (1=used, 0=free)
+ *  - section summary: one bit per leaf word, set when it still has a free frame
+ *  - section_free:    one bit per section, set when the section has a free frame
+ * Word indices stay global (frame >> 6); the directory resolves them to storage.
+ * Absent sections (NULL directory slots) read as fully used.
+ */
+#define SECTION_SHIFT PMM_SECTION_SHIFT                     /* 2^15 frames = 128 MiB */
+#define SECTION_FRAMES PMM_SECTION_FRAMES
+#define SECTION_WORDS (SECTION_FRAMES / 64)                 /* 512 leaf words */
+#define SECTION_SUMMARY_WORDS (SECTION_WORDS / 64)          /* 8 summary words */
+
+typedef struct mem_section
+{
+    uint64_t summary[SECTION_SUMMARY_WORDS];
+    uint64_t bitmap[SECTION_WORDS];
+} mem_section_t;
+
+static mem_section_t **section_dir = NULL;
+static uint64_t *section_free = NULL;
 static uint8_t bitmap_set = 0;
 static uint64_t bitmap_size_bytes = 0;
 static uint64_t bitmap_num_frames = 0;
+static uint64_t num_sections = 0;
+static uint64_t present_sections = 0;
+
+/* Frame descriptors (page.h); page_dir_sections stays 0 until init_page_map */
+page_t **page_dir = NULL;
+uint64_t page_dir_sections = 0;
+page_t *page_map = NULL;
+uint32_t *page_map_section = NULL;
+static uint64_t page_map_bytes = 0;
+
+/* Memory zones, each a contiguous frame slice with its own counters.
+ * Boundaries (16 MiB, 4 GiB) are multiples of 64 frames, so no leaf word
+ * is shared between two zones.
+ */
+typedef struct pmm_zone
+{
+    const char *name;
+    uint64_t start_frame;    /* first frame of the zone */
+    uint64_t end_frame;      /* one past the last frame */
+    uint64_t present_frames; /* usable frames reported by the memory map */
+    uint64_t free_frames;
+    uint64_t watermark_low;  /* fallback allocations never take the zone below this */
+    uint64_t cursor;         /* leaf word where the last single-frame search ended */
+#ifdef PMM_BACKEND_BUDDY
+    buddy_allocator_t buddy; /* seeded from the bitmap once reserved regions are marked */
+#endif
+} pmm_zone_t;
+
+static pmm_zone_t zones[PMM_ZONE_COUNT] = {
+    [PMM_ZONE_DMA] = {.name = "DMA"},
+    [PMM_ZONE_DMA32] = {.name = "DMA32"},
+    [PMM_ZONE_NORMAL] = {.name = "NORMAL"},
+};
 
 /* Statistics */
 static uint64_t total_frames = 0;
 static uint64_t free_frames = 0;
 static uint64_t highest_usable_addr = 0;
 
-/* Optimization: last allocation position */
-static uint64_t last_alloc_byte = 0;
-
 /* Utility functions */
 static inline uint64_t align_up(uint64_t x, uint64_t align) { return (x + align - 1) & ~(align - 1); }
 static inline uint64_t align_down(uint64_t x, uint64_t align) { return x & ~(align - 1); }
 static inline uint64_t div_round_up(uint64_t x, uint64_t divisor) { return (x + divisor - 1) / divisor; }
 
+/* Zone lookup by frame number */
+static inline pmm_zone_t *zone_of(uint64_t frame_idx)
+{
+    if (frame_idx < ZONE_DMA_LIMIT / PAGE_SIZE)
+        return &zones[PMM_ZONE_DMA];
+    if (frame_idx < ZONE_DMA32_LIMIT / PAGE_SIZE)
+        return &zones[PMM_ZONE_DMA32];
+    return &zones[PMM_ZONE_NORMAL];
+}
+
+/* Count usable frames [frame_start, frame_end) against the zones they fall in */
+static void __init zone_account_usable(uint64_t frame_start, uint64_t frame_end)
+{
+    static const uint64_t limits[PMM_ZONE_COUNT] = {
+        ZONE_DMA_LIMIT / PAGE_SIZE, ZONE_DMA32_LIMIT / PAGE_SIZE, ~0ULL};
+    uint64_t lo = 0;
+
+    for (unsigned z = 0; z < PMM_ZONE_COUNT; z++)
+    {
+        uint64_t start = frame_start > lo ? frame_start : lo;
+        uint64_t end = frame_end < limits[z] ? frame_end : limits[z];
+        if (end > start)
+            zones[z].present_frames += end - start;
+        lo = limits[z];
+    }
+}
+
+/* Clamp zone spans to the managed frame space and set watermarks */
+static void __init init_zones(uint64_t num_frames)
+{
+    static const uint64_t limits[PMM_ZONE_COUNT] = {
+        ZONE_DMA_LIMIT / PAGE_SIZE, ZONE_DMA32_LIMIT / PAGE_SIZE, ~0ULL};
+    uint64_t lo = 0;
+
+    for (unsigned z = 0; z < PMM_ZONE_COUNT; z++)
+    {
+        pmm_zone_t *zone = &zones[z];
+        zone->start_frame = lo < num_frames ? lo : num_frames;
+        zone->end_frame = limits[z] < num_frames ? limits[z] : num_frames;
+        zone->cursor = zone->start_frame >> 6;
+        lo = limits[z];
+
+        /* Keep ~1/64 of the zone (32 frames .. 16 MiB) for its own users */
+        uint64_t wm = zone->present_frames >> 6;
+        if (wm < 32)
+            wm = 32;
+        if (wm > 4096)
+            wm = 4096;
+        zone->watermark_low = wm < zone->present_frames ? wm : zone->present_frames;
+
+        kprintf("Zone %s: [%llx - %llx] %llu usable frames, low watermark %llu\n",
+                zone->name, zone->start_frame * PAGE_SIZE, zone->end_frame * PAGE_SIZE,
+                zone->present_frames, zone->watermark_low);
+    }
+}
+
+/* Does any available mmap entry overlap [start, end)? */
+static int __init range_has_ram(multiboot_tag_mmap *mm, uint64_t start, uint64_t end)
+{
+    uint32_t count = (mm->size - sizeof(*mm)) / mm->entry_size;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        multiboot_mmap_entry *entry = &mm->entries[i];
+        if (entry->type != MULTIBOOT_MMAP_AVAILABLE)
+            continue;
+
+        uint64_t a = align_up(entry->addr, PAGE_SIZE);
+        uint64_t b = align_down(entry->addr + entry->len, PAGE_SIZE);
+        if (a < end && b > start && b > a)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Number of sections covering num_frames that hold usable RAM */
+static uint64_t __init count_present_sections(uint64_t num_frames, multiboot_tag_mmap *mm)
+{
+    uint64_t sections = div_round_up(num_frames, SECTION_FRAMES);
+    uint64_t present = 0;
+
+    for (uint64_t si = 0; si < sections; si++)
+    {
+        if (range_has_ram(mm, (si << SECTION_SHIFT) * PAGE_SIZE, ((si + 1) << SECTION_SHIFT) * PAGE_SIZE))
+            present++;
+    }
+
+    return present;
+}
+
+/* Bytes needed for the section directory, section_free and present sections */
+static uint64_t __init bitmap_bytes_for(uint64_t num_frames, uint64_t present)
+{
+    uint64_t sections = div_round_up(num_frames, SECTION_FRAMES);
+
+    return sections * sizeof(mem_section_t *) +
+           div_round_up(sections, 64) * sizeof(uint64_t) +
+           present * sizeof(mem_section_t);
+}
+
+/* Bytes needed for the frame descriptors, their directory and reverse map */
+static uint64_t __init page_map_bytes_for(uint64_t num_frames, uint64_t present)
+{
+    uint64_t sections = div_round_up(num_frames, SECTION_FRAMES);
+
+    return present * SECTION_FRAMES * sizeof(page_t) +
+           sections * sizeof(page_t *) +
+           present * sizeof(uint32_t);
+}
+
+/* Leaf word by global index; absent sections read as fully used */
+static inline uint64_t leaf_word(uint64_t word)
+{
+    mem_section_t *sec = section_dir[word / SECTION_WORDS];
+    return sec ? sec->bitmap[word % SECTION_WORDS] : ~0ULL;
+}
+
+static inline int section_has_free(const mem_section_t *sec)
+{
+    uint64_t any = 0;
+    for (unsigned i = 0; i < SECTION_SUMMARY_WORDS; i++)
+        any |= sec->summary[i];
+    return any != 0;
+}
+
+/* Summary maintenance: called whenever a leaf word changes (local word index) */
+static inline void summary_word_full(mem_section_t *sec, uint64_t si, uint64_t lw)
+{
+    sec->summary[lw >> 6] &= ~(1ULL << (lw & 63));
+    if (!section_has_free(sec))
+        section_free[si >> 6] &= ~(1ULL << (si & 63));
+}
+
+static inline void summary_word_free(mem_section_t *sec, uint64_t si, uint64_t lw)
+{
+    sec->summary[lw >> 6] |= 1ULL << (lw & 63);
+    section_free[si >> 6] |= 1ULL << (si & 63);
+}
+
+/* First section index in [from, limit) that has a free frame, or -1 */
+static int64_t next_free_section(uint64_t from, uint64_t limit)
+{
+    if (from >= limit)
+        return -1;
+
+    uint64_t t = from >> 6;
+    uint64_t bits = section_free[t] & (~0ULL << (from & 63));
+
+    for (;;)
+    {
+        if (bits)
+        {
+            uint64_t si = (t << 6) + (uint64_t)__builtin_ctzll(bits);
+            return si < limit ? (int64_t)si : -1;
+        }
+
+        if (++t << 6 >= limit)
+            return -1;
+        bits = section_free[t];
+    }
+}
+
+/* First local leaf word >= lw in a section with a free frame, or -1 */
+static inline int64_t section_next_free_word(const mem_section_t *sec, uint64_t lw)
+{
+    uint64_t s = lw >> 6;
+    uint64_t bits = sec->summary[s] & (~0ULL << (lw & 63));
+
+    while (!bits)
+    {
+        if (++s >= SECTION_SUMMARY_WORDS)
+            return -1;
+        bits = sec->summary[s];
+    }
+
+    return (int64_t)((s << 6) + (uint64_t)__builtin_ctzll(bits));
+}
+
+/* First leaf word index in [from, limit) that has a free frame, or -1 */
+static int64_t next_free_word(uint64_t from, uint64_t limit)
+{
+    if (from >= limit)
+        return -1;
+
+    uint64_t si = from / SECTION_WORDS;
+    mem_section_t *sec = section_dir[si];
+    int64_t lw = sec ? section_next_free_word(sec, from % SECTION_WORDS) : -1;
+
+    if (lw < 0)
+    {
+        int64_t next = next_free_section(si + 1, div_round_up(limit, SECTION_WORDS));
+        if (next < 0)
+            return -1;
+        si = (uint64_t)next;
+        lw = section_next_free_word(section_dir[si], 0);
+        if (lw < 0)
+            return -1;
+    }
+
+    uint64_t word = si * SECTION_WORDS + (uint64_t)lw;
+    return word < limit ? (int64_t)word : -1;
+}
+
+/* First used frame in [lo, hi), or hi if the whole range is free.
+ * Whole free words skip 64 frames at a time.
+ */
+static uint64_t first_used_frame(uint64_t lo, uint64_t hi)
+{
+    uint64_t word = lo >> 6;
+    uint64_t bits = leaf_word(word) & (~0ULL << (lo & 63));
+
+    for (;;)
+    {
+        if (bits)
+        {
+            uint64_t frame = (word << 6) + (uint64_t)__builtin_ctzll(bits);
+            return frame < hi ? frame : hi;
+        }
+
+        if (++word << 6 >= hi)
+            return hi;
+        bits = leaf_word(word);
+    }
+}
+
+/* First free frame in [from, limit) (no wrap), or limit if none */
+static uint64_t next_free_frame(uint64_t from, uint64_t limit)
+{
+    if (from >= limit)
+        return limit;
+
+    uint64_t word = from >> 6;
+    uint64_t bits = ~leaf_word(word) & (~0ULL << (from & 63));
+    if (!bits)
+    {
+        int64_t next = next_free_word(word + 1, div_round_up(limit, 64));
+        if (next < 0)
+            return limit;
+        word = (uint64_t)next;
+        bits = ~leaf_word(word);
+    }
+
+    uint64_t frame = (word << 6) + (uint64_t)__builtin_ctzll(bits);
+    return frame < limit ? frame : limit;
+}
+
+/* Portable popcount: the kernel links without libgcc, so no __builtin_popcountll */
+static inline uint64_t popcount64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/* Set (value=1) or clear (value=0) bits [lo, hi) of a word array.
+ * Head and tail words are masked, whole words in between are filled.
+ * Returns the number of bits that changed state.
+ */
+static uint64_t bits_fill(uint64_t *words, uint64_t lo, uint64_t hi, int value)
+{
+    if (lo >= hi)
+        return 0;
+
+    uint64_t first = lo >> 6;
+    uint64_t last = (hi - 1) >> 6;
+    uint64_t head = ~0ULL << (lo & 63);
+    uint64_t tail = ~0ULL >> (63 - ((hi - 1) & 63));
+    uint64_t fill = value ? ~0ULL : 0;
+    uint64_t changed;
+
+    if (first == last)
+        head &= tail;
+
+    changed = popcount64((words[first] ^ fill) & head);
+    words[first] = (words[first] & ~head) | (fill & head);
+    if (first == last)
+        return changed;
+
+    for (uint64_t w = first + 1; w < last; w++)
+    {
+        changed += popcount64(words[w] ^ fill);
+        words[w] = fill;
+    }
+
+    changed += popcount64((words[last] ^ fill) & tail);
+    words[last] = (words[last] & ~tail) | (fill & tail);
+    return changed;
+}
+
+/* Mark local frames [lo, hi) of one section and refresh its summaries.
+ * Returns the number of frames that changed state.
+ */
+static uint64_t section_fill(mem_section_t *sec, uint64_t si, uint64_t lo, uint64_t hi, int used)
+{
+    uint64_t changed = bits_fill(sec->bitmap, lo, hi, used);
+    uint64_t first = lo >> 6;
+    uint64_t last = (hi - 1) >> 6;
+
+    if (!used)
+    {
+        /* Every touched leaf word now has a free frame */
+        bits_fill(sec->summary, first, last + 1, 1);
+        section_free[si >> 6] |= 1ULL << (si & 63);
+        return changed;
+    }
+
+    /* Leaf words fully inside the range are now full; edges may be too */
+    bits_fill(sec->summary, div_round_up(lo, 64), hi >> 6, 0);
+    if (sec->bitmap[first] == ~0ULL)
+        sec->summary[first >> 6] &= ~(1ULL << (first & 63));
+    if (sec->bitmap[last] == ~0ULL)
+        sec->summary[last >> 6] &= ~(1ULL << (last & 63));
+
+    if (!section_has_free(sec))
+        section_free[si >> 6] &= ~(1ULL << (si & 63));
+    return changed;
+}
+
+/* Mark global frames [lo, hi) section by section; absent sections are skipped */
+static uint64_t frames_fill(uint64_t lo, uint64_t hi, int used)
+{
+    uint64_t changed = 0;
+
+    while (lo < hi)
+    {
+        uint64_t si = lo >> SECTION_SHIFT;
+        uint64_t base = si << SECTION_SHIFT;
+        uint64_t end = base + SECTION_FRAMES < hi ? base + SECTION_FRAMES : hi;
+
+        if (section_dir[si])
+            changed += section_fill(section_dir[si], si, lo - base, end - base, used);
+        lo = end;
+    }
+
+    return changed;
+}
+
+/* Mark frames [lo, hi) used (used=1) or free (used=0) a word at a time.
+ * Zone and global counters move by one popcount-based delta per zone.
+ */
+static void update_frame_range(uint64_t lo, uint64_t hi, int used)
+{
+    if (!bitmap_set)
+        return;
+
+    if (hi > bitmap_num_frames)
+        hi = bitmap_num_frames;
+    if (lo >= hi)
+        return;
+
+    for (unsigned zi = 0; zi < PMM_ZONE_COUNT; zi++)
+    {
+        pmm_zone_t *z = &zones[zi];
+        uint64_t a = lo > z->start_frame ? lo : z->start_frame;
+        uint64_t b = hi < z->end_frame ? hi : z->end_frame;
+        if (a >= b)
+            continue;
+
+        uint64_t changed = frames_fill(a, b, used);
+        if (used)
+        {
+            z->free_frames -= changed;
+            free_frames -= changed;
+        }
+        else
+        {
+            z->free_frames += changed;
+            free_frames += changed;
+        }
+    }
+}
+
 /* Bitmap operations */
 static inline int test_frame(uint64_t frame_idx)
 {
-    if (!bitmap || frame_idx >= bitmap_num_frames)
+    if (!bitmap_set || frame_idx >= bitmap_num_frames)
         return 1;
 
-    uint64_t byte = frame_idx >> 3;
-    uint8_t bit = 1U << (frame_idx & 7);
-    return (bitmap[byte] & bit) != 0;
+    return (leaf_word(frame_idx >> 6) >> (frame_idx & 63)) & 1;
 }
 
 static inline void set_frame(uint64_t frame_idx)
 {
-    if (!bitmap || frame_idx >= bitmap_num_frames)
+    if (!bitmap_set || frame_idx >= bitmap_num_frames)
         return;
 
-    uint64_t byte = frame_idx >> 3;
-    uint8_t bit = 1U << (frame_idx & 7);
+    uint64_t si = frame_idx >> SECTION_SHIFT;
+    mem_section_t *sec = section_dir[si];
+    if (!sec)
+        return;
 
-    if (!(bitmap[byte] & bit))
+    uint64_t lw = (frame_idx >> 6) % SECTION_WORDS;
+    uint64_t bit = 1ULL << (frame_idx & 63);
+
+    if (!(sec->bitmap[lw] & bit))
     {
-        bitmap[byte] |= bit;
-        if (free_frames > 0)
-            free_frames--;
+        sec->bitmap[lw] |= bit;
+        if (sec->bitmap[lw] == ~0ULL)
+            summary_word_full(sec, si, lw);
+        free_frames--;
+        zone_of(frame_idx)->free_frames--;
     }
 }
 
@@ -81,130 +540,471 @@ static inline void clear_frame(uint64_t frame_idx)
     if (!bitmap_set || frame_idx >= bitmap_num_frames)
         return;
 
-    uint64_t byte = frame_idx >> 3;
-    uint8_t bit = 1U << (frame_idx & 7);
+    uint64_t si = frame_idx >> SECTION_SHIFT;
+    mem_section_t *sec = section_dir[si];
+    if (!sec)
+        return;
+
+    uint64_t lw = (frame_idx >> 6) % SECTION_WORDS;
+    uint64_t bit = 1ULL << (frame_idx & 63);
 
-    if (bitmap[byte] & bit)
+    if (sec->bitmap[lw] & bit)
     {
-        bitmap[byte] &= ~bit;
+        if (sec->bitmap[lw] == ~0ULL)
+            summary_word_free(sec, si, lw);
+        sec->bitmap[lw] &= ~bit;
         free_frames++;
+        zone_of(frame_idx)->free_frames++;
     }
 }
 
-/* Mark a physical range as used */
+/* Mark a physical range as used (rounded outwards to whole frames) */
 static void mark_region_used(uint64_t phys_start, uint64_t phys_end)
 {
     kprintf("Marking region: [%llx - %llx]\n", phys_start, phys_end);
     if (phys_end <= phys_start)
         return;
 
-    uint64_t frame_start = phys_start / PAGE_SIZE;
-    uint64_t frame_end = div_round_up(phys_end, PAGE_SIZE);
-
-    if (frame_start >= bitmap_num_frames)
-        return;
+    update_frame_range(phys_start / PAGE_SIZE, div_round_up(phys_end, PAGE_SIZE), 1);
+}
 
-    if (frame_end > bitmap_num_frames)
-        frame_end = bitmap_num_frames;
+/* Mark a physical range as free (rounded inwards to whole frames) */
+static void __init mark_region_free(uint64_t phys_start, uint64_t phys_end)
+{
+    uint64_t frame_start = div_round_up(phys_start, PAGE_SIZE);
+    uint64_t frame_end = phys_end / PAGE_SIZE;
 
-    for (uint64_t i = frame_start; i < frame_end; i++)
-        set_frame(i);
+    if (frame_end > frame_start)
+        update_frame_range(frame_start, frame_end, 0);
 }
 
-/* Initialize bitmap */
-static void init_bitmap(uint64_t bitmap_phys, uint64_t size_bytes, uint64_t num_frames)
+/* Initialize bitmap: lay out the directory, section_free and one section per
+ * 128 MiB slice that holds usable RAM. Every frame starts used.
+ */
+static void __init init_bitmap(uint64_t bitmap_phys, uint64_t size_bytes, uint64_t num_frames,
+                        multiboot_tag_mmap *mm)
 {
-    bitmap = (uint8_t *)(uintptr_t)bitmap_phys;
+    num_sections = div_round_up(num_frames, SECTION_FRAMES);
+    present_sections = 0;
+
+    section_dir = (mem_section_t **)phys_to_virt(bitmap_phys);
+    section_free = (uint64_t *)(section_dir + num_sections);
+    mem_section_t *next = (mem_section_t *)(section_free + div_round_up(num_sections, 64));
+
     bitmap_size_bytes = size_bytes;
     bitmap_num_frames = num_frames;
     bitmap_set = 1;
 
-    kprintf("init_bitmap: base=%llx size=%llu bytes (%llu frames)\n",
-            bitmap_phys, size_bytes, num_frames);
+    memset(section_free, 0, div_round_up(num_sections, 64) * sizeof(uint64_t));
+
+    /* Everything starts used; pmm_init frees the available mmap ranges */
+    for (uint64_t si = 0; si < num_sections; si++)
+    {
+        if (!range_has_ram(mm, (si << SECTION_SHIFT) * PAGE_SIZE, ((si + 1) << SECTION_SHIFT) * PAGE_SIZE))
+        {
+            section_dir[si] = NULL;
+            continue;
+        }
+
+        mem_section_t *sec = next++;
+        memset(sec->summary, 0, sizeof(sec->summary));
+        memset(sec->bitmap, 0xFF, sizeof(sec->bitmap));
+
+        section_dir[si] = sec;
+        present_sections++;
+    }
+
+    kprintf("init_bitmap: base=%llx size=%llu bytes (%llu frames, %llu of %llu sections present)\n",
+            bitmap_phys, size_bytes, num_frames, present_sections, num_sections);
 
-    /* Zero bitmap - all frames start free */
-    // memset(bitmap, 0, bitmap_size_bytes);
-    free_frames = bitmap_num_frames;
+    for (unsigned z = 0; z < PMM_ZONE_COUNT; z++)
+        zones[z].free_frames = 0;
+    free_frames = 0;
 }
 
-uint64_t pmm_alloc_frame(void)
+/* Lay out the frame descriptors at storage_phys (64-byte aligned) and tag
+ * every frame from the bitmap: free frames PAGE_TYPE_FREE, used ones
+ * PAGE_TYPE_RESERVED. Runs once all reserved regions are marked.
+ */
+static void __init init_page_map(uint64_t storage_phys)
 {
-    if (!bitmap_set)
+    page_map = (page_t *)phys_to_virt(storage_phys);
+    page_dir = (page_t **)(page_map + present_sections * SECTION_FRAMES);
+    page_map_section = (uint32_t *)(page_dir + num_sections);
+
+    page_t *next = page_map;
+    uint64_t ordinal = 0;
+
+    for (uint64_t si = 0; si < num_sections; si++)
     {
-        kprintf("pmm_alloc_frame: ERROR - PMM not initialized\n");
-        return 0;
+        mem_section_t *sec = section_dir[si];
+        if (!sec)
+        {
+            page_dir[si] = NULL;
+            continue;
+        }
+
+        page_dir[si] = next;
+        page_map_section[ordinal++] = (uint32_t)si;
+
+        /* Zone boundaries are multiples of 64 frames: one zone per leaf word */
+        for (uint64_t lw = 0; lw < SECTION_WORDS; lw++)
+        {
+            uint64_t used = sec->bitmap[lw];
+            uint8_t zone = (uint8_t)(zone_of((si << SECTION_SHIFT) + (lw << 6)) - zones);
+
+            for (unsigned bit = 0; bit < 64; bit++, next++)
+            {
+                next->next = NULL;
+                next->prev = NULL;
+                next->refcount = 0;
+                next->type = ((used >> bit) & 1) ? PAGE_TYPE_RESERVED : PAGE_TYPE_FREE;
+                next->zone = zone;
+                next->order = 0;
+                next->flags = 0;
+                next->private = 0;
+            }
+        }
     }
 
-    if (free_frames == 0)
+    page_dir_sections = num_sections;
+
+    kprintf("init_page_map: base=%llx size=%llu KB (%llu bytes per frame)\n",
+            storage_phys, page_map_bytes / 1024, (uint64_t)sizeof(page_t));
+}
+
+/* Hand frames [frame, frame + count) to a new owner with one reference each */
+static void pages_claim(uint64_t frame, uint64_t count)
+{
+    unsigned order = 0;
+    while ((1ULL << order) < count)
+        order++;
+
+    for (uint64_t i = 0; i < count; i++)
     {
-        kprintf("pmm_alloc_frame: ERROR - out of memory\n");
-        return 0;
+        page_t *page = pfn_to_page(frame + i);
+        if (!page)
+            continue;
+
+        page->next = NULL;
+        page->prev = NULL;
+        page->refcount = 1;
+        page->type = PAGE_TYPE_KERNEL;
+        page->order = i == 0 ? (uint8_t)order : 0;
+        page->flags = 0;
+        page->private = 0;
     }
+}
 
-    /* Search from last allocation point */
-    uint64_t start_byte = last_alloc_byte;
+/* Tag frames [frame, frame + count) free again */
+static void pages_release(uint64_t frame, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        page_t *page = pfn_to_page(frame + i);
+        if (!page)
+            continue;
 
-    for (uint64_t offset = 0; offset < bitmap_size_bytes; offset++)
+        page->refcount = 0;
+        page->type = PAGE_TYPE_FREE;
+        page->order = 0;
+    }
+}
+
+/* Allocate `count` frames aligned to `align_frames` inside one zone.
+ * Returns the first frame or -1.
+ */
+static int64_t bitmap_zone_alloc(pmm_zone_t *z, uint64_t count, uint64_t align_frames)
+{
+    if (count == 1 && align_frames == 1)
     {
-        uint64_t byte_idx = (start_byte + offset) % bitmap_size_bytes;
+        /* Search from the zone's cursor through the summary levels, wrapping once */
+        uint64_t lo = z->start_frame >> 6;
+        uint64_t hi = div_round_up(z->end_frame, 64);
+        int64_t word = next_free_word(z->cursor, hi);
+        if (word < 0)
+            word = next_free_word(lo, z->cursor);
+        if (word < 0)
+            return -1;
+
+        uint64_t frame_idx = ((uint64_t)word << 6) + (uint64_t)__builtin_ctzll(~leaf_word((uint64_t)word));
+        z->cursor = (uint64_t)word;
+        set_frame(frame_idx);
+        return (int64_t)frame_idx;
+    }
+
+    uint64_t start = align_up(next_free_frame(z->start_frame, z->end_frame), align_frames);
 
-        if (bitmap[byte_idx] != 0xFF)
+    while (start < z->end_frame && count <= z->end_frame - start)
+    {
+        uint64_t used = first_used_frame(start, start + count);
+        if (used == start + count)
         {
-            for (int bit = 0; bit < 8; bit++)
-            {
-                uint8_t mask = 1U << bit;
+            update_frame_range(start, start + count, 1);
+            return (int64_t)start;
+        }
 
-                if (!(bitmap[byte_idx] & mask))
-                {
-                    /* Found free frame */
-                    bitmap[byte_idx] |= mask;
-                    last_alloc_byte = byte_idx;
+        /* Restart at the next aligned free frame past the obstacle */
+        start = align_up(next_free_frame(used + 1, z->end_frame), align_frames);
+    }
 
-                    uint64_t frame_idx = (byte_idx << 3) + bit;
+    return -1;
+}
 
-                    if (frame_idx >= bitmap_num_frames)
-                        return 0;
+/* Free frames [frame_idx, frame_idx + count) that all lie in zone z */
+static void bitmap_zone_free(pmm_zone_t *z, uint64_t frame_idx, uint64_t count)
+{
+    (void)z;
+    if (count == 1)
+        clear_frame(frame_idx);
+    else
+        update_frame_range(frame_idx, frame_idx + count, 0);
+}
 
-                    free_frames--;
-                    return frame_idx * PAGE_SIZE;
-                }
-            }
+#ifndef PMM_BACKEND_BUDDY
+
+static inline int64_t zone_alloc(pmm_zone_t *z, uint64_t count, uint64_t align_frames)
+{
+    return bitmap_zone_alloc(z, count, align_frames);
+}
+
+static inline void zone_free(pmm_zone_t *z, uint64_t frame_idx, uint64_t count)
+{
+    bitmap_zone_free(z, frame_idx, count);
+}
+
+#else /* PMM_BACKEND_BUDDY */
+
+/* Until seed_buddy runs, the bitmap serves allocations */
+static uint8_t buddy_ready = 0;
+
+/* Refresh zone and global counters from the zone's buddy allocator */
+static inline void zone_sync(pmm_zone_t *z)
+{
+    free_frames = free_frames - z->free_frames + z->buddy.free_frames;
+    z->free_frames = z->buddy.free_frames;
+}
+
+/* Hand every free run left in the bitmap after init to the zone buddies */
+static void __init seed_buddy(uint64_t storage_phys)
+{
+    for (unsigned zi = 0; zi < PMM_ZONE_COUNT; zi++)
+    {
+        pmm_zone_t *z = &zones[zi];
+        uint64_t span = z->end_frame - z->start_frame;
+
+        buddy_init(&z->buddy, phys_to_virt(storage_phys), z->start_frame, span);
+        storage_phys += buddy_storage_bytes(z->start_frame, span);
+
+        uint64_t frame = next_free_frame(z->start_frame, z->end_frame);
+        while (frame < z->end_frame)
+        {
+            uint64_t end = first_used_frame(frame, z->end_frame);
+            buddy_free_range(&z->buddy, frame, end - frame);
+            frame = next_free_frame(end, z->end_frame);
+        }
+
+        zone_sync(z);
+    }
+
+    buddy_ready = 1;
+    kprintf("seed_buddy: %llu free frames handed to buddy allocator\n", free_frames);
+}
+
+static int64_t zone_alloc(pmm_zone_t *z, uint64_t count, uint64_t align_frames)
+{
+    int64_t frame;
+
+    if (!buddy_ready)
+        return bitmap_zone_alloc(z, count, align_frames);
+
+    if (count == 1 && align_frames == 1)
+        frame = buddy_alloc(&z->buddy, 0);
+    else
+        frame = buddy_alloc_frames(&z->buddy, count, align_frames);
+
+    zone_sync(z);
+    return frame;
+}
+
+static void zone_free(pmm_zone_t *z, uint64_t frame_idx, uint64_t count)
+{
+    if (!buddy_ready)
+    {
+        bitmap_zone_free(z, frame_idx, count);
+        return;
+    }
+
+    if (count == 1)
+        buddy_free(&z->buddy, frame_idx, 0);
+    else
+        buddy_free_range(&z->buddy, frame_idx, count);
+
+    zone_sync(z);
+}
+
+#endif /* PMM_BACKEND_BUDDY */
+
+/* Highest zone a request may use; fallback walks down from there */
+static inline unsigned zone_highest(uint32_t flags)
+{
+    if (flags & PMM_ALLOC_DMA)
+        return PMM_ZONE_DMA;
+    if (flags & PMM_ALLOC_DMA32)
+        return PMM_ZONE_DMA32;
+    return PMM_ZONE_NORMAL;
+}
+
+uint64_t pmm_alloc_frames_zone(uint64_t count, uint64_t align, uint32_t flags)
+{
+    if (!bitmap_set)
+    {
+        kprintf("pmm_alloc_frames: ERROR - PMM not initialized\n");
+        return 0;
+    }
+
+    if (align == 0)
+        align = PAGE_SIZE;
+
+    if (count == 0 || (align & (align - 1)) || align % PAGE_SIZE)
+    {
+        kprintf("pmm_alloc_frames: ERROR - bad request (count=%llu align=%llx)\n", count, align);
+        return 0;
+    }
+
+    unsigned first = zone_highest(flags);
+
+    for (int zi = (int)first; zi >= 0; zi--)
+    {
+        pmm_zone_t *z = &zones[zi];
+
+        if (z->free_frames < count)
+            continue;
+
+        /* Falling back into a lower zone must leave its reserve intact */
+        if ((unsigned)zi != first && z->free_frames - count < z->watermark_low)
+            continue;
+
+        int64_t frame = zone_alloc(z, count, align / PAGE_SIZE);
+        if (frame >= 0)
+        {
+            pages_claim((uint64_t)frame, count);
+            return (uint64_t)frame * PAGE_SIZE;
         }
     }
 
-    kprintf("pmm_alloc_frame: ERROR - no free frames (inconsistent state)\n");
+    kprintf("pmm_alloc_frames: ERROR - no run of %llu frames aligned to %llx (flags %x)\n",
+            count, align, flags);
     return 0;
 }
 
-void pmm_free_frame(uint64_t phys_addr)
+uint64_t pmm_alloc_frame_zone(uint32_t flags)
+{
+    return pmm_alloc_frames_zone(1, PAGE_SIZE, flags);
+}
+
+uint64_t pmm_alloc_frame(void)
+{
+    return pmm_alloc_frames_zone(1, PAGE_SIZE, PMM_ALLOC_NORMAL);
+}
+
+uint64_t pmm_alloc_frames(uint64_t count, uint64_t align)
+{
+    return pmm_alloc_frames_zone(count, align, PMM_ALLOC_NORMAL);
+}
+
+void pmm_free_frames(uint64_t phys_addr, uint64_t count)
 {
     if (!bitmap_set)
         return;
 
     if (phys_addr % PAGE_SIZE)
     {
-        kprintf("pmm_free_frame: ERROR - address %llx not page-aligned\n", phys_addr);
+        kprintf("pmm_free_frames: ERROR - address %llx not page-aligned\n", phys_addr);
         return;
     }
 
     uint64_t frame_idx = phys_addr / PAGE_SIZE;
 
-    if (frame_idx >= bitmap_num_frames)
+    if (frame_idx >= bitmap_num_frames || count > bitmap_num_frames - frame_idx)
     {
-        kprintf("pmm_free_frame: ERROR - frame %llu out of range\n", frame_idx);
+        kprintf("pmm_free_frames: ERROR - frames [%llu +%llu] out of range\n", frame_idx, count);
         return;
     }
 
     /* Don't free frame 0 */
-    if (frame_idx == 0)
+    if (frame_idx == 0 && count)
+    {
+        frame_idx++;
+        count--;
+    }
+
+    /* A frame already free may sit inside a larger merged buddy block,
+     * which buddy_free cannot see; reject the whole call instead.
+     */
+    for (uint64_t i = 0; i < count; i++)
+    {
+        page_t *page = pfn_to_page(frame_idx + i);
+        if (page && page->type == PAGE_TYPE_FREE)
+        {
+            kprintf("pmm_free_frames: ERROR - frame %llu already free (double free)\n",
+                    frame_idx + i);
+            return;
+        }
+    }
+
+    pages_release(frame_idx, count);
+
+    /* Split the run at zone boundaries */
+    while (count)
+    {
+        pmm_zone_t *z = zone_of(frame_idx);
+        uint64_t n = z->end_frame - frame_idx;
+        if (n > count)
+            n = count;
+
+        zone_free(z, frame_idx, n);
+        frame_idx += n;
+        count -= n;
+    }
+}
+
+void pmm_free_frame(uint64_t phys_addr)
+{
+    pmm_free_frames(phys_addr, 1);
+}
+
+void page_get(page_t *page)
+{
+    if (!page || page->refcount == 0)
+    {
+        kprintf("page_get: ERROR - frame %llx is not allocated\n", page ? page_to_phys(page) : 0);
+        return;
+    }
+
+    page->refcount++;
+}
+
+void page_put(page_t *page)
+{
+    if (!page || page->refcount == 0)
+    {
+        kprintf("page_put: ERROR - frame %llx is not allocated\n", page ? page_to_phys(page) : 0);
         return;
+    }
 
-    clear_frame(frame_idx);
+    if (--page->refcount == 0)
+        pmm_free_frame(page_to_phys(page));
 }
 
 uint64_t pmm_get_free_frames(void) { return free_frames; }
 uint64_t pmm_get_total_frames(void) { return total_frames; }
 
+uint64_t pmm_get_zone_free_frames(pmm_zone_id_t zone)
+{
+    return zone < PMM_ZONE_COUNT ? zones[zone].free_frames : 0;
+}
+
 void pmm_print_stats(void)
 {
     kprintf("\n=== PMM Statistics ===\n");
@@ -217,13 +1017,28 @@ void pmm_print_stats(void)
             total_frames - free_frames);
     kprintf("Highest usable: %llx (%llu MiB)\n",
             highest_usable_addr, highest_usable_addr / (1024 * 1024));
-    kprintf("Bitmap: %llu KB\n", bitmap_size_bytes / 1024);
+    kprintf("Bitmap: %llu KB (%llu of %llu 128 MiB sections present)\n",
+            bitmap_size_bytes / 1024, present_sections, num_sections);
+    kprintf("Page map: %llu KB (%llu bytes per frame)\n",
+            page_map_bytes / 1024, (uint64_t)sizeof(page_t));
+    for (unsigned z = 0; z < PMM_ZONE_COUNT; z++)
+    {
+        kprintf("Zone %s: %llu / %llu frames free (low %llu)\n",
+                zones[z].name, zones[z].free_frames, zones[z].present_frames,
+                zones[z].watermark_low);
+#ifdef PMM_BACKEND_BUDDY
+        buddy_print_stats(&zones[z].buddy);
+#endif
+    }
+    pmm_zero_pool_print_stats();
     kprintf("======================\n\n");
 }
 
-void pmm_init(multiboot_size_tag *s)
+void __init pmm_init(multiboot_size_tag *s)
 {
-    uint64_t reserved_multiboot_range = align_up((uint64_t)s + (uint64_t)s->total_size, PAGE_SIZE);
+    uint64_t mb_start = align_down(virt_to_phys(s), PAGE_SIZE);
+    uint64_t mb_end = align_up(virt_to_phys(s) + (uint64_t)s->total_size, PAGE_SIZE);
+    uint64_t init_start_tsc = rdtsc();
     kprintf("\n=== Initializing PMM ===\n");
 
     uint64_t usable_bytes = 0;
@@ -257,6 +1072,7 @@ void pmm_init(multiboot_size_tag *s)
                     {
                         uint64_t frames = (end - start) / PAGE_SIZE;
                         total_frames += frames;
+                        zone_account_usable(start / PAGE_SIZE, end / PAGE_SIZE);
                         usable_bytes += (end - start);
                         if (end > highest_usable_addr)
                             highest_usable_addr = end;
@@ -281,40 +1097,83 @@ void pmm_init(multiboot_size_tag *s)
 
     /* Calculate bitmap size */
     uint64_t addr_space_frames = div_round_up(highest_usable_addr, PAGE_SIZE);
-    uint64_t bitmap_bytes_needed = div_round_up(addr_space_frames, 8);
+    uint64_t present = count_present_sections(addr_space_frames, mmap_tag);
+    uint64_t bitmap_bytes_needed = bitmap_bytes_for(addr_space_frames, present);
+    init_zones(addr_space_frames);
+#ifdef PMM_BACKEND_BUDDY
+    uint64_t buddy_storage_offset = bitmap_bytes_needed;
+    for (unsigned z = 0; z < PMM_ZONE_COUNT; z++)
+        bitmap_bytes_needed += buddy_storage_bytes(zones[z].start_frame,
+                                                   zones[z].end_frame - zones[z].start_frame);
+#endif
 
     kprintf("Bitmap size: %llu KB for %llu frames\n",
             bitmap_bytes_needed / 1024, addr_space_frames);
 
+    /* Frame descriptors follow, cache-line aligned */
+    uint64_t page_map_offset = align_up(bitmap_bytes_needed, 64);
+    page_map_bytes = page_map_bytes_for(addr_space_frames, present);
+    uint64_t meta_bytes_needed = page_map_offset + page_map_bytes;
+
+    kprintf("Page map size: %llu KB\n", page_map_bytes / 1024);
+
     /* Get kernel boundaries */
     uint64_t kernel_start = (uint64_t)&_kernel_start;
     uint64_t kernel_end = align_up((uint64_t)&_kernel_end, PAGE_SIZE);
 
-    kprintf("Kernel: [%llx - %llx] (%llu KB)\n",
-            kernel_start, kernel_end, (kernel_end - kernel_start) / 1024);
+    kprintf("Kernel: [%llx - %llx] (%llu KB), Multiboot: [%llx - %llx]\n",
+            kernel_start, kernel_end, (kernel_end - kernel_start) / 1024, mb_start, mb_end);
 
-    /* Reserve PT allocation area */
-    if (kernel_end >= align_down((uint64_t)s, PAGE_SIZE))
-        kernel_end = reserved_multiboot_range;
-    kprintf("Kernel end: %llx, Multiboot start: %llx\n", kernel_end, align_down((uint64_t)s, PAGE_SIZE));
-    
-    uint64_t pt_alloc_start = align_up(kernel_end, PAGE_SIZE);
-    uint64_t pt_alloc_end = pt_alloc_start + PT_RESERVE_BYTES;
+    /* The page tables come from a bootmem region inside what the boot
+     * tables map; the bitmap and page map can go anywhere once they are built
+     */
+    uint64_t map_end = align_up(highest_usable_addr, PAGE_SIZE);
+    uint64_t pt_reserve_bytes = kernel_map_reserve_bytes(map_end, kernel_end);
+    bootmem_range_t exclude[] = {
+        {0, PAGE_SIZE}, /* frame 0 */
+        {kernel_start, kernel_end},
+        {mb_start, mb_end},
+    };
+
+    if (bootmem_init(mmap_tag, pt_reserve_bytes, exclude, sizeof(exclude) / sizeof(exclude[0])) != 0)
+    {
+        kprintf("FATAL: No space for page tables\n");
+        return;
+    }
+
+    uint64_t pt_alloc_start = bootmem_alloc(pt_reserve_bytes, PAGE_SIZE);
+    uint64_t pt_alloc_end = pt_alloc_start + pt_reserve_bytes;
+
+    kprintf("PT reserve: [%llx - %llx] (%llu KB)\n",
+            pt_alloc_start, pt_alloc_end, pt_reserve_bytes / 1024);
 
-    if (pt_alloc_end > EARLY_IDENTITY_LIMIT)
+    /* Build the direct map and kernel window, then switch to them */
+    kprintf("\nBuilding kernel page tables...\n");
+    if (kernel_map_all(map_end, kernel_end, pt_alloc_start, pt_alloc_end) != 0)
     {
-        kprintf("FATAL: PT area exceeds early identity map.\n");
+        kprintf("FATAL: Failed to build kernel page tables\n");
         return;
     }
 
-    kprintf("PT reserve: [%llx - %llx] (%llu MB)\n",
-            pt_alloc_start, pt_alloc_end, PT_RESERVE_BYTES / (1024 * 1024));
+    /* Only the used part of the reserve stays allocated */
+    bootmem_discard(pt_alloc_trim(), pt_alloc_end);
 
-    /* Find space for bitmap */
     uint64_t bitmap_start = 0;
-    uint64_t bitmap_end = 0;
-    int found = 0;
+    if (bootmem_add_region(mmap_tag, meta_bytes_needed, exclude,
+                           sizeof(exclude) / sizeof(exclude[0])) == 0)
+        bitmap_start = bootmem_alloc(meta_bytes_needed, PAGE_SIZE);
+    if (!bitmap_start)
+    {
+        kprintf("FATAL: No space for bitmap\n");
+        return;
+    }
+    kprintf("Bitmap: [%llx - %llx]\n", bitmap_start, bitmap_start + meta_bytes_needed);
+
+    /* Initialize bitmap */
+    uint64_t bitmap_start_tsc = rdtsc();
+    init_bitmap(bitmap_start, bitmap_bytes_needed, addr_space_frames, mmap_tag);
 
+    /* Free available memory */
     tag = (multiboot_tag *)((uint8_t *)s + 8);
     while (tag->type != MULTIBOOT_TAG_TYPE_END)
     {
@@ -326,67 +1185,26 @@ void pmm_init(multiboot_size_tag *s)
             for (uint32_t i = 0; i < count; i++)
             {
                 multiboot_mmap_entry *entry = &mm->entries[i];
-
-                if (entry->type != MULTIBOOT_MMAP_AVAILABLE)
-                    continue;
-
-                uint64_t region_start = align_up(entry->addr, PAGE_SIZE);
-                uint64_t region_end = align_down(entry->addr + entry->len, PAGE_SIZE);
-
-                /* Skip kernel */
-                if (region_start < kernel_end && region_end > kernel_start)
-                    region_start = kernel_end;
-
-                /* Skip PT area */
-                if (region_start < pt_alloc_end && region_end > pt_alloc_start)
-                    region_start = pt_alloc_end;
-
-                if (region_end <= region_start)
-                    continue;
-
-                if (region_end - region_start >= bitmap_bytes_needed)
-                {
-                    bitmap_start = region_start;
-                    bitmap_end = region_start + bitmap_bytes_needed;
-                    found = 1;
-                    kprintf("Bitmap: [%llx - %llx]\n", bitmap_start, bitmap_end);
-                    break;
-                }
+                if (entry->type == MULTIBOOT_MMAP_AVAILABLE)
+                    mark_region_free(entry->addr, entry->addr + entry->len);
             }
-            if (found) break;
         }
-
         tag = (multiboot_tag *)((uint8_t *)tag + ((tag->size + 7) & ~7));
     }
 
-    if (!found)
-    {
-        kprintf("FATAL: No space for bitmap\n");
-        return;
-    }
-
-    /* Build identity map */
-    kprintf("\nBuilding identity map...\n");
-    uint64_t map_end = align_up(highest_usable_addr, PAGE_SIZE);
-
-    if (identity_map_all(map_end, pt_alloc_start, pt_alloc_end) != 0)
-    {
-        kprintf("FATAL: Failed to build identity mapping\n");
-        return;
-    }
-
-    /* Initialize bitmap */
-    init_bitmap(bitmap_start, bitmap_bytes_needed, addr_space_frames);
-
     /* Mark reserved regions */
     kprintf("\nMarking reserved regions...\n");
     mark_region_used(0, PAGE_SIZE);  /* Frame 0 */
     mark_region_used(kernel_start, kernel_end);
-    mark_region_used(align_down((uint64_t)s, PAGE_SIZE), align_up((uint64_t)reserved_multiboot_range, PAGE_SIZE));
-    mark_region_used(pt_alloc_start, pt_alloc_end);
-    mark_region_used(bitmap_start, bitmap_end);
+    mark_region_used(mb_start, mb_end);
 
-    /* Mark non-usable memory */
+    /* The whole arena (page tables, bitmap, scratch) until bootmem_release */
+    bootmem_range_t regions[BOOTMEM_MAX_REGIONS];
+    unsigned region_count = bootmem_regions(regions);
+    for (unsigned r = 0; r < region_count; r++)
+        mark_region_used(regions[r].start, regions[r].end);
+
+    /* Mark non-usable memory (covers available entries overlapping reserved ones) */
     tag = (multiboot_tag *)((uint8_t *)s + 8);
     while (tag->type != MULTIBOOT_TAG_TYPE_END)
     {
@@ -409,6 +1227,19 @@ void pmm_init(multiboot_size_tag *s)
         tag = (multiboot_tag *)((uint8_t *)tag + ((tag->size + 7) & ~7));
     }
 
+    init_page_map(bitmap_start + page_map_offset);
+
+    uint64_t bitmap_end_tsc = rdtsc();
+
+#ifdef PMM_BACKEND_BUDDY
+    seed_buddy(bitmap_start + buddy_storage_offset);
+#endif
+
+    pmm_zero_pool_refill();
+
+    uint64_t init_end_tsc = rdtsc();
     kprintf("\n=== PMM Initialization Complete ===\n");
+    kprintf("pmm_init: %llu cycles total, %llu cycles for bitmap setup and marking\n",
+            init_end_tsc - init_start_tsc, bitmap_end_tsc - bitmap_start_tsc);
     pmm_print_stats();
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * tlb.c - TLB management and PCID allocation.
+ * Responsibilities:
+ *  - turn on CR4.PGE and CR4.PCIDE when the CPU has them
+ *  - hand out PCIDs to address spaces and recycle them by generation
+ *  - switch CR3 with the no-flush bit while a PCID is still valid
+ *  - invalidate pages, ranges, PCIDs or the whole TLB (INVPCID if present)
+ * Notes:
+ *  - PCIDE is only enabled together with PGE, so a full flush can always
+ *    toggle CR4.PGE when INVPCID is missing
+ *  - a newly assigned PCID is loaded without CR3_NOFLUSH, which drops
+ *    whatever an earlier owner left behind under that tag
+ *  - the boot and kernel tables run with PCID 0 (TLB_PCID_KERNEL)
+ *  - tlb_flush_all is an alternatives jump site: INVPCID or the CR4.PGE
+ *    toggle is chosen once at boot, not per call
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpu_features.h>
+#include <lib/cpu_regs.h>
+#include <lib/alternatives.h>
+#include <memory/physical/pmm.h>
+#include <memory/virtual/tlb.h>
+
+/* INVPCID types */
+#define INVPCID_CONTEXT 1ULL    /* one PCID (non-global) */
+#define INVPCID_ALL_GLOBAL 2ULL /* everything, global included */
+#define INVPCID_ALL 3ULL        /* every PCID, global excluded */
+
+/* First address past the lower canonical half */
+#define USER_SPACE_END 0x0000800000000000ULL
+
+static int pge_enabled = 0;
+static int pcid_enabled = 0;
+static int has_invpcid = 0;
+
+/* Current PCID generation; tlb_asid_t.generation 0 means "never assigned" */
+static uint64_t tlb_generation = 1;
+static uint16_t next_pcid = TLB_PCID_KERNEL + 1;
+static uint16_t cur_pcid = TLB_PCID_KERNEL;
+
+static struct
+{
+    uint64_t switches;
+    uint64_t noflush_switches;
+    uint64_t pcids_assigned;
+    uint64_t rollovers;
+    uint64_t page_flushes;
+    uint64_t pcid_flushes;
+    uint64_t full_flushes;
+} tlb_stats;
+
+static inline void invlpg(uint64_t virt)
+{
+    __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint16_t pcid, uint64_t addr)
+{
+    struct
+    {
+        uint64_t pcid;
+        uint64_t addr;
+    } desc = {pcid, addr};
+
+    __asm__ volatile("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+/* Flush every PCID's non-global entries (global ones too without INVPCID) */
+static void flush_all_pcids(void)
+{
+    if (has_invpcid)
+        invpcid(INVPCID_ALL, 0, 0);
+    else
+        tlb_flush_all();
+}
+
+/* Give asid a PCID of the current generation, starting a new one if needed */
+static void assign_pcid(tlb_asid_t *asid)
+{
+    if (next_pcid > TLB_PCID_MAX)
+    {
+        tlb_generation++;
+        next_pcid = TLB_PCID_KERNEL + 1;
+        flush_all_pcids();
+        tlb_stats.rollovers++;
+    }
+
+    asid->pcid = next_pcid++;
+    asid->generation = tlb_generation;
+    tlb_stats.pcids_assigned++;
+}
+
+void __init tlb_init(void)
+{
+    uint64_t cr4 = read_cr4();
+
+    if (cpu_has(X86_FEATURE_PGE))
+    {
+        cr4 |= CR4_PGE;
+        pge_enabled = 1;
+
+        /* CR3[11:0] is 0 here (page-aligned PML4, no PWT/PCD) */
+        if (cpu_has(X86_FEATURE_PCID))
+        {
+            cr4 |= CR4_PCIDE;
+            pcid_enabled = 1;
+            has_invpcid = cpu_has(X86_FEATURE_INVPCID);
+        }
+    }
+
+    write_cr4(cr4);
+    cur_pcid = TLB_PCID_KERNEL;
+
+    kprintf("tlb_init: global pages %s, PCID %s, INVPCID %s\n",
+            pge_enabled ? "enabled" : "not supported",
+            pcid_enabled ? "enabled" : "not supported",
+            has_invpcid ? "available" : "not supported");
+}
+
+void tlb_switch(tlb_asid_t *asid, uint64_t pml4_phys)
+{
+    tlb_stats.switches++;
+
+    if (!pcid_enabled)
+    {
+        write_cr3(pml4_phys);
+        return;
+    }
+
+    uint64_t cr3 = pml4_phys & ~CR3_PCID_MASK;
+    uint16_t pcid = TLB_PCID_KERNEL;
+
+    if (asid && asid->generation != tlb_generation)
+    {
+        assign_pcid(asid);
+        pcid = asid->pcid;
+    }
+    else
+    {
+        if (asid)
+            pcid = asid->pcid;
+        cr3 |= CR3_NOFLUSH;
+        tlb_stats.noflush_switches++;
+    }
+
+    cur_pcid = pcid;
+    write_cr3(cr3 | pcid);
+}
+
+uint16_t tlb_current_pcid(void)
+{
+    return cur_pcid;
+}
+
+void tlb_flush_page(uint64_t virt)
+{
+    invlpg(virt);
+    tlb_stats.page_flushes++;
+}
+
+void tlb_flush_range(uint64_t start, uint64_t end)
+{
+    start &= ~(PAGE_SIZE - 1);
+    if (end <= start)
+        return;
+
+    uint64_t pages = (end - start + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages <= TLB_FLUSH_RANGE_THRESHOLD)
+    {
+        for (uint64_t v = start; v < end; v += PAGE_SIZE)
+            invlpg(v);
+        tlb_stats.page_flushes += pages;
+        return;
+    }
+
+    /* Kernel mappings are global: a PCID flush would keep them */
+    if (end > USER_SPACE_END)
+        tlb_flush_all();
+    else
+        tlb_flush_pcid(cur_pcid);
+}
+
+void tlb_flush_pcid(uint16_t pcid)
+{
+    tlb_stats.pcid_flushes++;
+
+    if (has_invpcid)
+    {
+        invpcid(INVPCID_CONTEXT, pcid, 0);
+        return;
+    }
+
+    /* Reloading CR3 without CR3_NOFLUSH flushes the current PCID only */
+    if (pcid == cur_pcid)
+    {
+        write_cr3(read_cr3() & ~CR3_NOFLUSH);
+        return;
+    }
+
+    tlb_flush_all();
+}
+
+static __attribute__((used)) void tlb_flush_all_invpcid(void)
+{
+    tlb_stats.full_flushes++;
+    invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+}
+
+static __attribute__((used)) void tlb_flush_all_generic(void)
+{
+    tlb_stats.full_flushes++;
+
+    /* Toggling CR4.PGE drops every entry, global and all PCIDs included */
+    uint64_t cr4 = read_cr4();
+    if (cr4 & CR4_PGE)
+    {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    }
+    else
+    {
+        write_cr3(read_cr3());
+    }
+}
+
+/* INVPCID type 2 needs no CR4.PCIDE, only the instruction */
+ALT_JUMP_SITE(tlb_flush_all, tlb_flush_all_generic);
+ALT_JUMP(tlb_flush_all, X86_FEATURE_INVPCID, tlb_flush_all_invpcid);
+
+void tlb_print_stats(void)
+{
+    kprintf("=== TLB Statistics ===\n");
+    kprintf("Switches: %llu (%llu without flush), PCIDs: %llu assigned, %llu rollovers\n",
+            tlb_stats.switches, tlb_stats.noflush_switches,
+            tlb_stats.pcids_assigned, tlb_stats.rollovers);
+    kprintf("Flushes: %llu pages, %llu PCIDs, %llu full\n",
+            tlb_stats.page_flushes, tlb_stats.pcid_flushes, tlb_stats.full_flushes);
+}
@@ -0,0 +1,464 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * vmm.c - Virtual Memory Manager for the kernel address space.
+ * Responsibilities:
+ *  - map, unmap and re-protect arbitrary page ranges
+ *  - allocate page-table pages from the PMM and give them back once empty
+ *  - split 2 MiB / 1 GiB pages when an operation covers only part of one
+ *  - batch TLB invalidation per call (per page up to a threshold, else a
+ *    full flush through the TLB layer)
+ * Notes:
+ *  - operates on the PML4 that is live in CR3 when vmm_init runs
+ *  - page tables are reached through the direct map (phys_to_virt)
+ *  - the PML4 itself is never freed; all lower tables are
+ *  - NX is only set in entries when EFER.NXE could be enabled
+ *  - creating a mapping never needs a flush: non-present entries are not cached
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/init.h>
+#include <lib/cpu_features.h>
+#include <lib/cpu_regs.h>
+#include <memory/layout.h>
+#include <memory/physical/pmm.h>
+#include <memory/physical/page.h>
+#include <memory/physical/identity_map.h>
+#include <memory/virtual/vmm.h>
+#include <memory/virtual/tlb.h>
+
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+/* Level 4 = PML4, 3 = PDPT, 2 = PD, 1 = PT */
+#define LEVEL_SHIFT(level) (12U + 9U * ((level) - 1U))
+#define LEVEL_SPAN(level) (1ULL << LEVEL_SHIFT(level))
+
+#define VMM_FLAG_MASK (VMM_WRITE | VMM_USER | VMM_PWT | VMM_PCD | VMM_PAT | VMM_GLOBAL | VMM_NX)
+
+typedef enum
+{
+    VMM_OP_UNMAP,
+    VMM_OP_PROTECT
+} vmm_op_t;
+
+/* Pages whose translation changed during one call */
+typedef struct tlb_batch
+{
+    uint64_t addr[VMM_INVLPG_THRESHOLD];
+    unsigned count;
+    int full;
+} tlb_batch_t;
+
+static uint64_t *kernel_pml4 = NULL;
+
+/* VMM_NX if EFER.NXE is on, else 0 (NX would be a reserved bit) */
+static uint64_t nx_mask = 0;
+
+static struct
+{
+    uint64_t tables_allocated;
+    uint64_t tables_freed;
+    uint64_t pages_mapped;
+    uint64_t pages_unmapped;
+    uint64_t large_splits;
+    uint64_t invlpgs;
+    uint64_t full_flushes;
+} vmm_stats;
+
+static inline unsigned level_index(uint64_t virt, unsigned level)
+{
+    return (virt >> LEVEL_SHIFT(level)) & 0x1FF;
+}
+
+static inline uint64_t *entry_table(uint64_t entry)
+{
+    return (uint64_t *)phys_to_virt(entry & PTE_ADDR_MASK);
+}
+
+/* End of the naturally aligned block of `span` bytes holding virt, capped at end */
+static inline uint64_t block_end(uint64_t virt, uint64_t span, uint64_t end)
+{
+    uint64_t next = (virt & ~(span - 1)) + span;
+    return (next > virt && next < end) ? next : end;
+}
+
+static inline void tlb_batch_add(tlb_batch_t *b, uint64_t virt)
+{
+    if (b->full)
+        return;
+    if (b->count == VMM_INVLPG_THRESHOLD)
+    {
+        b->full = 1;
+        return;
+    }
+    b->addr[b->count++] = virt;
+}
+
+static void tlb_batch_flush(tlb_batch_t *b)
+{
+    if (b->full)
+    {
+        tlb_flush_all();
+        vmm_stats.full_flushes++;
+        return;
+    }
+
+    for (unsigned i = 0; i < b->count; i++)
+        tlb_flush_page(b->addr[i]);
+    vmm_stats.invlpgs += b->count;
+}
+
+/* Allocate a zeroed page-table page from the PMM zero pool, or NULL */
+static uint64_t *alloc_table(void)
+{
+    uint64_t phys = pmm_alloc_zeroed_frame();
+    if (!phys)
+        return NULL;
+
+    uint64_t *table = (uint64_t *)phys_to_virt(phys);
+
+    page_t *page = phys_to_page(phys);
+    if (page)
+        page->type = PAGE_TYPE_PAGETABLE;
+
+    vmm_stats.tables_allocated++;
+    return table;
+}
+
+static void free_table(uint64_t *table)
+{
+    pmm_free_frame(virt_to_phys(table));
+    vmm_stats.tables_freed++;
+}
+
+static int table_empty(const uint64_t *table)
+{
+    for (unsigned i = 0; i < PTE_ENTRIES; i++)
+    {
+        if (table[i])
+            return 0;
+    }
+    return 1;
+}
+
+/* Hardware bits for a leaf at `level` from VMM_* flags */
+static uint64_t leaf_bits(uint64_t flags, unsigned level)
+{
+    uint64_t e = PAGE_PRESENT | (flags & (VMM_WRITE | VMM_USER | VMM_PWT | VMM_PCD | VMM_GLOBAL));
+
+    e |= flags & nx_mask;
+    if (level > 1)
+    {
+        e |= PAGE_HUGE;
+        if (flags & VMM_PAT)
+            e |= PAGE_PAT_LARGE;
+    }
+    else if (flags & VMM_PAT)
+    {
+        e |= PAGE_PAT;
+    }
+    return e;
+}
+
+/* Physical frame of a leaf entry at `level` */
+static inline uint64_t leaf_phys(uint64_t entry, unsigned level)
+{
+    return entry & PTE_ADDR_MASK & ~(LEVEL_SPAN(level) - 1);
+}
+
+/* Replace the large leaf table[idx] (at `level`) by a table of 512 smaller
+ * leaves with the same translation and attributes.
+ */
+static int split_large(uint64_t *table, unsigned idx, unsigned level)
+{
+    uint64_t *child = alloc_table();
+    if (!child)
+    {
+        kprintf("vmm: ERROR - no frame to split large page\n");
+        return -1;
+    }
+
+    uint64_t entry = table[idx];
+    uint64_t phys = leaf_phys(entry, level);
+    uint64_t attrs = (entry & ~PTE_ADDR_MASK) | (entry & PAGE_PAT_LARGE);
+    uint64_t child_span = LEVEL_SPAN(level - 1);
+
+    /* 4 KiB leaves have no PS bit and keep PAT in bit 7 */
+    if (level - 1 == 1)
+    {
+        attrs &= ~(PAGE_HUGE | PAGE_PAT_LARGE);
+        if (entry & PAGE_PAT_LARGE)
+            attrs |= PAGE_PAT;
+    }
+
+    for (unsigned i = 0; i < PTE_ENTRIES; i++)
+        child[i] = (phys + (uint64_t)i * child_span) | attrs;
+
+    table[idx] = virt_to_phys(child) | PAGE_PRESENT_RW | (entry & PAGE_USER);
+    vmm_stats.large_splits++;
+    return 0;
+}
+
+/* Set by map_level to the first address it did not map */
+static uint64_t map_reached;
+
+static int map_level(uint64_t *table, unsigned level, uint64_t virt, uint64_t end,
+                     uint64_t phys, uint64_t bits)
+{
+    unsigned idx = level_index(virt, level);
+
+    if (level == 1)
+    {
+        for (; virt < end; virt += PAGE_SIZE, phys += PAGE_SIZE, idx++)
+        {
+            if (table[idx] & PAGE_PRESENT)
+            {
+                kprintf("vmm_map: ERROR - %llx is already mapped\n", virt);
+                map_reached = virt;
+                return -1;
+            }
+            table[idx] = phys | bits;
+            vmm_stats.pages_mapped++;
+        }
+        map_reached = end;
+        return 0;
+    }
+
+    while (virt < end)
+    {
+        uint64_t next = block_end(virt, LEVEL_SPAN(level), end);
+        uint64_t entry = table[idx];
+        uint64_t *child;
+
+        if (!(entry & PAGE_PRESENT))
+        {
+            child = alloc_table();
+            if (!child)
+            {
+                kprintf("vmm_map: ERROR - out of memory for page tables at %llx\n", virt);
+                map_reached = virt;
+                return -1;
+            }
+            table[idx] = virt_to_phys(child) | PAGE_PRESENT_RW | (bits & PAGE_USER);
+        }
+        else if (entry & PAGE_HUGE)
+        {
+            kprintf("vmm_map: ERROR - %llx is already mapped by a large page\n", virt);
+            map_reached = virt;
+            return -1;
+        }
+        else
+        {
+            child = entry_table(entry);
+            table[idx] |= bits & PAGE_USER;
+        }
+
+        if (map_level(child, level - 1, virt, next, phys, bits) != 0)
+            return -1;
+
+        phys += next - virt;
+        virt = next;
+        idx++;
+    }
+
+    return 0;
+}
+
+/* Apply op to the leaves in [virt, end) below table (at `level`) */
+static int update_level(uint64_t *table, unsigned level, uint64_t virt, uint64_t end,
+                        vmm_op_t op, uint64_t flags, tlb_batch_t *b)
+{
+    uint64_t span = LEVEL_SPAN(level);
+
+    while (virt < end)
+    {
+        unsigned idx = level_index(virt, level);
+        uint64_t next = block_end(virt, span, end);
+        uint64_t entry = table[idx];
+
+        if (!(entry & PAGE_PRESENT))
+        {
+            virt = next;
+            continue;
+        }
+
+        if (level == 1 || (entry & PAGE_HUGE))
+        {
+            /* Partly covered large page: split and look again */
+            if (level > 1 && ((virt & (span - 1)) || next - virt < span))
+            {
+                if (split_large(table, idx, level) != 0)
+                    return -1;
+                continue;
+            }
+
+            uint64_t new_entry = 0;
+            if (op == VMM_OP_PROTECT)
+                new_entry = leaf_phys(entry, level) | leaf_bits(flags, level);
+            else
+                vmm_stats.pages_unmapped += span / PAGE_SIZE;
+
+            if (new_entry != entry)
+            {
+                table[idx] = new_entry;
+                tlb_batch_add(b, virt);
+            }
+            virt = next;
+            continue;
+        }
+
+        uint64_t *child = entry_table(entry);
+        if (update_level(child, level - 1, virt, next, op, flags, b) != 0)
+            return -1;
+
+        if (op == VMM_OP_UNMAP && table_empty(child))
+        {
+            table[idx] = 0;
+            free_table(child);
+        }
+        else if (op == VMM_OP_PROTECT && (flags & VMM_USER))
+        {
+            table[idx] |= PAGE_USER;
+        }
+        virt = next;
+    }
+
+    return 0;
+}
+
+/* Free tables on the path to virt that are empty (after a failed vmm_map) */
+static void prune_path(uint64_t virt)
+{
+    uint64_t *path[4];
+    unsigned idx[4];
+    uint64_t *table = kernel_pml4;
+    unsigned depth = 0;
+
+    for (unsigned level = 4; level > 1; level--)
+    {
+        unsigned i = level_index(virt, level);
+        if ((table[i] & (PAGE_PRESENT | PAGE_HUGE)) != PAGE_PRESENT)
+            break;
+        path[depth] = table;
+        idx[depth] = i;
+        depth++;
+        table = entry_table(table[i]);
+    }
+
+    /* table is the deepest table reached; walk back up while empty */
+    while (depth > 0 && table_empty(table))
+    {
+        depth--;
+        path[depth][idx[depth]] = 0;
+        free_table(table);
+        table = path[depth];
+    }
+}
+
+static int check_range(const char *who, uint64_t virt, uint64_t size)
+{
+    if (!kernel_pml4)
+    {
+        kprintf("%s: ERROR - vmm_init has not run\n", who);
+        return -1;
+    }
+
+    if ((virt | size) & (PAGE_SIZE - 1))
+    {
+        kprintf("%s: ERROR - unaligned range (virt %llx, size %llx)\n", who, virt, size);
+        return -1;
+    }
+
+    if (virt + size < virt)
+    {
+        kprintf("%s: ERROR - range at %llx wraps\n", who, virt);
+        return -1;
+    }
+
+    return 0;
+}
+
+void __init vmm_init(void)
+{
+    kernel_pml4 = (uint64_t *)phys_to_virt(read_cr3() & PTE_ADDR_MASK);
+
+    if (cpu_has(X86_FEATURE_NX))
+    {
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+        nx_mask = VMM_NX;
+    }
+
+    kprintf("vmm_init: PML4 at %llx, NX %s\n",
+            virt_to_phys(kernel_pml4), nx_mask ? "enabled" : "not supported");
+}
+
+int vmm_map(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags)
+{
+    if (check_range("vmm_map", virt, size) != 0)
+        return -1;
+
+    if (phys & (PAGE_SIZE - 1))
+    {
+        kprintf("vmm_map: ERROR - unaligned phys %llx\n", phys);
+        return -1;
+    }
+
+    if (flags & ~VMM_FLAG_MASK)
+    {
+        kprintf("vmm_map: ERROR - unknown flags %llx\n", flags & ~VMM_FLAG_MASK);
+        return -1;
+    }
+
+    if (size == 0)
+        return 0;
+
+    if (map_level(kernel_pml4, 4, virt, virt + size, phys, leaf_bits(flags, 1)) == 0)
+        return 0;
+
+    /* Roll back what this call mapped, then drop tables it left empty */
+    tlb_batch_t batch = {.count = 0, .full = 0};
+    update_level(kernel_pml4, 4, virt, map_reached, VMM_OP_UNMAP, 0, &batch);
+    prune_path(map_reached);
+    tlb_batch_flush(&batch);
+    return -1;
+}
+
+int vmm_unmap(uint64_t virt, uint64_t size)
+{
+    if (check_range("vmm_unmap", virt, size) != 0)
+        return -1;
+
+    tlb_batch_t batch = {.count = 0, .full = 0};
+    int ret = update_level(kernel_pml4, 4, virt, virt + size, VMM_OP_UNMAP, 0, &batch);
+    tlb_batch_flush(&batch);
+    return ret;
+}
+
+int vmm_protect(uint64_t virt, uint64_t size, uint64_t flags)
+{
+    if (check_range("vmm_protect", virt, size) != 0)
+        return -1;
+
+    if (flags & ~VMM_FLAG_MASK)
+    {
+        kprintf("vmm_protect: ERROR - unknown flags %llx\n", flags & ~VMM_FLAG_MASK);
+        return -1;
+    }
+
+    tlb_batch_t batch = {.count = 0, .full = 0};
+    int ret = update_level(kernel_pml4, 4, virt, virt + size, VMM_OP_PROTECT, flags, &batch);
+    tlb_batch_flush(&batch);
+    return ret;
+}
+
+void vmm_print_stats(void)
+{
+    kprintf("=== VMM Statistics ===\n");
+    kprintf("Page tables: %llu allocated, %llu freed\n",
+            vmm_stats.tables_allocated, vmm_stats.tables_freed);
+    kprintf("Pages: %llu mapped, %llu unmapped, %llu large pages split\n",
+            vmm_stats.pages_mapped, vmm_stats.pages_unmapped, vmm_stats.large_splits);
+    kprintf("TLB: %llu invlpg, %llu full flushes\n",
+            vmm_stats.invlpgs, vmm_stats.full_flushes);
+}
@@ -0,0 +1,125 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * printf_bench.c - Host benchmark of ksnprintf against the host snprintf.
+ * Responsibilities:
+ *  - time formats typical of kernel messages with both, in ns per call
+ *  - time kvformat into a sink that drops the output, i.e. the formatter
+ *    alone
+ * Notes:
+ *  - usage: printf_bench [calls per format]
+ *  - the numbers are only comparable on the same machine and build
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <lib/print.h>
+
+static volatile uint64_t seed = 0x12345678ABCDULL;
+static volatile size_t sink_bytes;
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+static void discard_sink(void *ctx, const char *s, size_t n)
+{
+    (void)ctx;
+    (void)s;
+    sink_bytes += n;
+}
+
+static int kdiscard(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    (void)buf;
+    (void)size;
+    va_start(args, fmt);
+    int n = kvformat(discard_sink, NULL, fmt, args);
+    va_end(args);
+    return n;
+}
+
+typedef int (*snprintf_fn)(char *buf, size_t size, const char *fmt, ...);
+
+/* One format: ns per call of fn */
+typedef double (*bench_fn)(snprintf_fn fn, long calls);
+
+static double bench_region(snprintf_fn fn, long calls)
+{
+    char buf[256];
+    uint64_t x = seed;
+    double t = now_ns();
+
+    for (long i = 0; i < calls; i++)
+        fn(buf, sizeof(buf), "Marking region: [%llx - %llx] %llu frames\n",
+           x + (uint64_t)i, x * 3 + (uint64_t)i, (x >> 12) + (uint64_t)i);
+    return (now_ns() - t) / (double)calls;
+}
+
+static double bench_table(snprintf_fn fn, long calls)
+{
+    char buf[256];
+    uint64_t x = seed;
+    double t = now_ns();
+
+    for (long i = 0; i < calls; i++)
+        fn(buf, sizeof(buf), "  %-10s %8u %8u %6llu KiB %3d%%\n", "kmalloc-256",
+           (unsigned)(x + (uint64_t)i), (unsigned)i, x >> 20, (int)(i % 100));
+    return (now_ns() - t) / (double)calls;
+}
+
+static double bench_ptr(snprintf_fn fn, long calls)
+{
+    char buf[256];
+    uint64_t x = seed;
+    double t = now_ns();
+
+    for (long i = 0; i < calls; i++)
+        fn(buf, sizeof(buf), "page %p order %d zone %s\n",
+           (void *)(uintptr_t)(x + (uint64_t)i * 4096), (int)(i & 7), "DMA32");
+    return (now_ns() - t) / (double)calls;
+}
+
+static double bench_literal(snprintf_fn fn, long calls)
+{
+    char buf[256];
+    double t = now_ns();
+
+    for (long i = 0; i < calls; i++)
+        fn(buf, sizeof(buf), "\n=== Initializing PMM: building the kernel page tables ===\n");
+    return (now_ns() - t) / (double)calls;
+}
+
+int main(int argc, char **argv)
+{
+    long calls = argc > 1 ? atol(argv[1]) : 2000000;
+    static const struct
+    {
+        const char *name;
+        bench_fn fn;
+    } formats[] = {
+        {"region (3x %llx/%llu)", bench_region},
+        {"table (%-s %u %llu %d%%)", bench_table},
+        {"pointer (%p %d %s)", bench_ptr},
+        {"literal text", bench_literal},
+    };
+
+    if (calls <= 0)
+        calls = 1;
+
+    printf("%-28s %12s %12s %12s\n", "format (ns/call)", "ksnprintf", "snprintf", "kvformat");
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        double k = formats[i].fn(ksnprintf, calls);
+        double g = formats[i].fn(snprintf, calls);
+        double d = formats[i].fn(kdiscard, calls);
+        printf("%-28s %12.1f %12.1f %12.1f\n", formats[i].name, k, g, d);
+    }
+    return 0;
+}
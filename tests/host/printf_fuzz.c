@@ -0,0 +1,403 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * printf_fuzz.c - Fuzz test of ksnprintf against the host snprintf.
+ * Responsibilities:
+ *  - build random conversion specs (flags, width, precision, both also
+ *    as *, length modifiers) and compare output and return value
+ *  - use small buffer sizes for a quarter of the cases, so truncation is
+ *    covered; bytes past the size given must stay untouched
+ *  - check the kernel's 0x convention against a model instead of glibc
+ * Notes:
+ *  - usage: printf_fuzz [iterations] [seed]
+ *  - %lx / %llx / %jx / %tx without '#', and %p, always print 0x in the
+ *    kernel. For a value other than 0 that is glibc's %#llx. For 0 glibc
+ *    prints no prefix (and "(nil)" for %p); model_hex_zero builds the
+ *    kernel's "0x0" instead.
+ *  - %b (binary) and unknown conversions have no glibc counterpart and
+ *    are covered by the fixed cases in check_fixed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <lib/print.h>
+
+#define BUF_BYTES 192
+#define GUARD 0xA5
+
+typedef enum
+{
+    ARG_INT,
+    ARG_WIDE, // 64-bit integer (l, ll, z, j, t)
+    ARG_CHAR,
+    ARG_STR,
+    ARG_PTR,
+    ARG_NONE, // %%
+} arg_kind_t;
+
+typedef struct
+{
+    char fmt[48];
+    char flags[8];
+    int width; // -1: none
+    int prec;  // -1: none
+    int star_width;
+    int star_prec;
+    const char *len;
+    char conv;
+    arg_kind_t kind;
+    uint64_t v;
+    const char *s;
+} spec_t;
+
+typedef int (*snprintf_fn)(char *buf, size_t size, const char *fmt, ...);
+
+static uint64_t rng_state;
+
+static uint64_t rnd(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static unsigned rnd_below(unsigned n)
+{
+    return (unsigned)(rnd() % n);
+}
+
+/* Mostly edge values: 0, 1, small, sign and width boundaries */
+static uint64_t rnd_value(void)
+{
+    static const uint64_t edges[] = {
+        0, 1, 9, 10, 99, 100, 0x7F, 0x80, 0xFF, 0x7FFF, 0x8000, 0xFFFF,
+        0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, 0x7FFFFFFFFFFFFFFFULL,
+        0x8000000000000000ULL, 0xFFFFFFFFFFFFFFFFULL,
+    };
+
+    switch (rnd_below(4))
+    {
+    case 0:
+        return edges[rnd_below(sizeof(edges) / sizeof(edges[0]))];
+    case 1:
+        return rnd() & 0xFFFF;
+    case 2:
+        return 0 - (rnd() & 0xFFF);
+    default:
+        return rnd() >> rnd_below(64);
+    }
+}
+
+/* Does the kernel print 0x where glibc does not? */
+static int kernel_prefix(const spec_t *sp)
+{
+    if (sp->conv == 'p')
+        return 1;
+    if (sp->conv != 'x' && sp->conv != 'X')
+        return 0;
+    if (strchr(sp->flags, '#'))
+        return 0;
+    return !strcmp(sp->len, "l") || !strcmp(sp->len, "ll") ||
+           !strcmp(sp->len, "j") || !strcmp(sp->len, "t");
+}
+
+/* Append flags, width, precision, length and conversion to fmt */
+static void build_fmt(char *fmt, const spec_t *sp, const char *extra_flags,
+                      const char *len, char conv)
+{
+    char *p = fmt;
+
+    *p++ = '%';
+    p += sprintf(p, "%s%s", sp->flags, extra_flags);
+    if (sp->star_width)
+        *p++ = '*';
+    else if (sp->width >= 0)
+        p += sprintf(p, "%d", sp->width);
+    if (sp->star_prec)
+        p += sprintf(p, ".*");
+    else if (sp->prec >= 0)
+        p += sprintf(p, ".%d", sp->prec);
+    sprintf(p, "%s%c", len, conv);
+}
+
+static void rnd_spec(spec_t *sp)
+{
+    static const char convs[] = "diuxXocspp%";
+    static const char *const int_lens[] = {"", "hh", "h", "l", "ll", "z", "j", "t"};
+    static const char *const strs[] = {"", "a", "hello", "a longer string, with spaces"};
+    const char *allowed;
+
+    memset(sp, 0, sizeof(*sp));
+    sp->conv = convs[rnd_below(sizeof(convs) - 1)];
+    sp->len = "";
+    sp->width = -1;
+    sp->prec = -1;
+
+    switch (sp->conv)
+    {
+    case 'd':
+    case 'i':
+        allowed = "-0+ ";
+        sp->len = int_lens[rnd_below(8)];
+        break;
+    case 'u':
+        allowed = "-0+ ";
+        sp->len = int_lens[rnd_below(8)];
+        break;
+    case 'x':
+    case 'X':
+    case 'o':
+        allowed = "-0#";
+        sp->len = int_lens[rnd_below(8)];
+        break;
+    case 'p':
+        allowed = "-0";
+        break;
+    case '%':
+        allowed = "";
+        break;
+    default: // c, s
+        allowed = "-";
+        break;
+    }
+
+    char *f = sp->flags;
+    for (const char *a = allowed; *a; a++)
+    {
+        if (rnd_below(4) == 0)
+            *f++ = *a;
+    }
+
+    if (sp->conv != '%')
+    {
+        unsigned w = rnd_below(3);
+        if (w == 1)
+            sp->width = 1 + (int)rnd_below(40);
+        else if (w == 2)
+        {
+            sp->star_width = 1;
+            sp->width = (int)rnd_below(81) - 40; // negative means '-'
+        }
+    }
+
+    if (sp->conv != '%' && sp->conv != 'c')
+    {
+        unsigned p = rnd_below(3);
+        if (p == 1)
+            sp->prec = (int)rnd_below(30);
+        else if (p == 2)
+        {
+            sp->star_prec = 1;
+            sp->prec = (int)rnd_below(36) - 5; // negative means none
+        }
+    }
+
+    build_fmt(sp->fmt, sp, "", sp->len, sp->conv);
+
+    sp->v = rnd_value();
+    sp->s = strs[rnd_below(4)];
+    if (sp->conv == '%')
+        sp->kind = ARG_NONE;
+    else if (sp->conv == 'c')
+        sp->kind = ARG_CHAR;
+    else if (sp->conv == 's')
+        sp->kind = ARG_STR;
+    else if (sp->conv == 'p')
+        sp->kind = ARG_PTR;
+    else if (sp->len[0] == 'l' || sp->len[0] == 'z' || sp->len[0] == 'j' || sp->len[0] == 't')
+        sp->kind = ARG_WIDE;
+    else
+        sp->kind = ARG_INT;
+}
+
+/* fn(buf, size, fmt, [width], [prec], arg) */
+#define CALL(fn, buf, size, fmt, sp, arg)                                   \
+    ((sp)->star_width && (sp)->star_prec ? fn(buf, size, fmt, (sp)->width, (sp)->prec, arg) \
+     : (sp)->star_width                  ? fn(buf, size, fmt, (sp)->width, arg)             \
+     : (sp)->star_prec                   ? fn(buf, size, fmt, (sp)->prec, arg)              \
+                                         : fn(buf, size, fmt, arg))
+
+static int run(snprintf_fn fn, char *buf, size_t size, const char *fmt,
+               const spec_t *sp, arg_kind_t kind)
+{
+    switch (kind)
+    {
+    case ARG_INT:
+        return CALL(fn, buf, size, fmt, sp, (int)sp->v);
+    case ARG_WIDE:
+        return CALL(fn, buf, size, fmt, sp, (unsigned long long)sp->v);
+    case ARG_CHAR:
+        return CALL(fn, buf, size, fmt, sp, (int)('A' + sp->v % 26));
+    case ARG_STR:
+        return CALL(fn, buf, size, fmt, sp, sp->s);
+    case ARG_PTR:
+        return CALL(fn, buf, size, fmt, sp, (void *)(uintptr_t)sp->v);
+    default:
+        return fn(buf, size, fmt);
+    }
+}
+
+/* The kernel's 0x form of the value 0, as snprintf would truncate it */
+static int model_hex_zero(char *buf, size_t size, const spec_t *sp)
+{
+    int left = strchr(sp->flags, '-') != NULL;
+    int zero = strchr(sp->flags, '0') != NULL;
+    int width = sp->width;
+    int prec = sp->prec;
+    char field[128];
+
+    if (sp->star_width && width < 0) // '*' with a negative value
+    {
+        left = 1;
+        width = -width;
+    }
+    else if (width < 0)
+        width = 0;
+    if (prec < 0)
+        prec = -1;
+
+    // body: no digit for precision 0, otherwise at least one
+    char body[64];
+    int blen = prec < 0 ? 1 : prec;
+    memset(body, '0', (size_t)blen);
+
+    int zeros = 0;
+    if (zero && !left && prec < 0 && width > 2 + blen)
+        zeros = width - 2 - blen;
+
+    int len = 2 + zeros + blen;
+    int pad = width > len ? width - len : 0;
+    char *p = field;
+
+    if (!left)
+        p += sprintf(p, "%*s", pad, "");
+    *p++ = '0';
+    *p++ = sp->conv == 'X' ? 'X' : 'x';
+    memset(p, '0', (size_t)(zeros + blen));
+    p += zeros + blen;
+    if (left)
+        p += sprintf(p, "%*s", pad, "");
+    *p = '\0';
+
+    return snprintf(buf, size, "%s", field);
+}
+
+/* What ksnprintf should produce for sp */
+static int expected(char *buf, size_t size, const spec_t *sp)
+{
+    if (!kernel_prefix(sp))
+        return run(snprintf, buf, size, sp->fmt, sp, sp->kind);
+
+    if (sp->v == 0)
+        return model_hex_zero(buf, size, sp);
+
+    // 0x and at least one digit: glibc's alternate form
+    char fmt[48];
+    build_fmt(fmt, sp, "#", "ll", sp->conv == 'X' ? 'X' : 'x');
+    return run(snprintf, buf, size, fmt, sp, ARG_WIDE);
+}
+
+static int fails = 0;
+
+static void report(const char *what, const char *fmt, size_t size,
+                   const char *got, int got_n, const char *want, int want_n)
+{
+    if (fails++ < 20)
+        printf("FAIL %s: \"%s\" size %zu: \"%s\" (%d), expected \"%s\" (%d)\n",
+               what, fmt, size, got, got_n, want, want_n);
+}
+
+/* Kernel-only behaviour, exact strings */
+static void check_fixed(void)
+{
+    static const struct
+    {
+        const char *want;
+        int n;
+        size_t size;
+        const char *fmt;
+        unsigned long long v;
+    } cases[] = {
+        {"0x0", 3, 64, "%llx", 0},
+        {"0xff", 4, 64, "%lx", 255},
+        {"0XFF", 4, 64, "%lX", 255},
+        {"ff", 2, 64, "%x", 255},
+        {"0x0000ab", 8, 64, "%08lx", 0xAB},
+        {"0x", 2, 64, "%.0lx", 0},
+        {"    0x1f", 8, 64, "%8llx", 0x1F},
+        {"0x1f    |", 9, 64, "%-8llx|", 0x1F},
+        {"101", 3, 64, "%b", 5},
+        {"00000101", 8, 64, "%08b", 5},
+        {"%q", 2, 64, "%q", 0},
+        {"0x1", 11, 4, "%llx", 0x123456789ULL}, // truncated
+        {"", 4, 1, "%lx", 0x10},
+        {"0x0", 3, 64, "%p", 0},
+    };
+    char buf[64];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        int n;
+        if (!strcmp(cases[i].fmt, "%p"))
+            n = ksnprintf(buf, cases[i].size, cases[i].fmt, (void *)(uintptr_t)cases[i].v);
+        else if (strchr(cases[i].fmt, 'l'))
+            n = ksnprintf(buf, cases[i].size, cases[i].fmt, cases[i].v);
+        else
+            n = ksnprintf(buf, cases[i].size, cases[i].fmt, (unsigned)cases[i].v);
+
+        if (n != cases[i].n || strcmp(buf, cases[i].want))
+            report("fixed", cases[i].fmt, cases[i].size, buf, n, cases[i].want, cases[i].n);
+    }
+
+    // size 0 writes nothing at all
+    memset(buf, GUARD, sizeof(buf));
+    int n = ksnprintf(buf, 0, "%d", 12345);
+    if (n != 5 || (unsigned char)buf[0] != GUARD)
+        report("size 0", "%d", 0, "(written)", n, "", 5);
+}
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 1000000;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x5EED;
+    if (!rng_state)
+        rng_state = 1;
+
+    char got[BUF_BYTES], want[BUF_BYTES];
+    long truncated = 0, prefixed = 0;
+    spec_t sp;
+
+    check_fixed();
+
+    for (long it = 0; it < iters; it++)
+    {
+        rnd_spec(&sp);
+
+        size_t size = sizeof(got);
+        if (rnd_below(4) == 0)
+            size = rnd_below(16);
+
+        memset(got, GUARD, sizeof(got));
+        memset(want, GUARD, sizeof(want));
+        int got_n = run(ksnprintf, got, size, sp.fmt, &sp, sp.kind);
+        int want_n = expected(want, size, &sp);
+
+        if (size < (size_t)want_n + 1)
+            truncated++;
+        prefixed += kernel_prefix(&sp);
+
+        if (got_n != want_n || memcmp(got, want, sizeof(got)))
+        {
+            // terminate for printing; size 0 leaves both untouched
+            got[sizeof(got) - 1] = want[sizeof(want) - 1] = '\0';
+            report("fuzz", sp.fmt, size, size ? got : "", got_n, size ? want : "", want_n);
+        }
+    }
+
+    printf("printf_fuzz: %ld cases (%ld truncated, %ld with the kernel 0x form), %d failures\n",
+           iters, truncated, prefixed, fails);
+    return fails != 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Licensed under MIT License - URIX project.
+ * stubs.c - Host stand-ins for what print.c links against in the kernel.
+ * Responsibilities:
+ *  - swallow log ring and console output (klog / kprintf are not tested)
+ *  - provide utoa from lib/string.c
+ * Notes:
+ *  - memcpy, strlen and strnlen come from the host libc; they have the
+ *    same names and ABI as the kernel versions
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lib/print.h>
+#include <lib/log.h>
+#include <lib/string.h>
+
+uint64_t log_store_flags(int level, uint8_t flags, const char *text, size_t len)
+{
+    (void)level;
+    (void)flags;
+    (void)text;
+    (void)len;
+    return 0;
+}
+
+void log_console_flush(void)
+{
+}
+
+uint8_t vga_entry_color(vga_color_t fg, vga_color_t bg)
+{
+    return (uint8_t)(fg | bg << 4);
+}
+
+void console_initialize(void)
+{
+}
+
+void console_set_color(uint8_t color)
+{
+    (void)color;
+}
+
+void console_writestring(const char *data)
+{
+    (void)data;
+}
+
+char *utoa(uint64_t num, char *buffer, int base)
+{
+    char tmp[65];
+    size_t n = 0;
+
+    do
+    {
+        unsigned d = (unsigned)(num % (unsigned)base);
+        tmp[n++] = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+        num /= (unsigned)base;
+    } while (num);
+
+    for (size_t i = 0; i < n; i++)
+        buffer[i] = tmp[n - 1 - i];
+    buffer[n] = '\0';
+    return buffer;
+}